@@ -0,0 +1,102 @@
+# Copyright (C) 2021 Niklas Jacob
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+# Resumable attack campaigns over a (delay, duration) box.
+#
+# The points are taken from a Halton sequence (bases 2 and 3), which covers
+# the box evenly for any number of points. The sequence is shifted by a
+# random offset (modulo 1), so that campaigns with different seeds test
+# different points. The sequence index, the seed and all results are
+# written to a JSON file after every attempt, a campaign started again with
+# the same file continues with the next point.
+
+import json
+import os
+import random
+
+BASES = (2, 3)
+
+def radical_inverse(i, base):
+    inv, f = 0.0, 1.0 / base
+    while i > 0:
+        inv += f * (i % base)
+        i //= base
+        f /= base
+    return inv
+
+def halton(i, shift):
+    return [(radical_inverse(i + 1, b) + s) % 1.0 for (b, s) in zip(BASES, shift)]
+
+class Campaign:
+
+    def __init__(self, filename, waits, vid, delay_min, delay_max, dur_min, dur_max, seed=None):
+        self.filename = filename
+        self.config = {
+            'waits' : waits,
+            'vid' : vid,
+            'delay' : [delay_min, delay_max],
+            'duration' : [dur_min, dur_max],
+        }
+        self.seed = seed if seed is not None else random.randrange(1 << 32)
+        self.index = 0
+        self.done = []
+
+        if os.path.exists(filename):
+            self.load()
+
+        r = random.Random(self.seed)
+        self.shift = [r.random() for _ in BASES]
+
+    def load(self):
+        with open(self.filename, 'r') as f:
+            state = json.load(f)
+        if state['config'] != self.config:
+            raise ValueError(f'{self.filename} belongs to another campaign: {state["config"]}')
+        self.seed = state['seed']
+        self.index = state['index']
+        self.done = state['done']
+
+    def save(self):
+        # write a new file and replace the old one, so an interrupted
+        # campaign never leaves a broken state behind
+        tmp = self.filename + '.tmp'
+        with open(tmp, 'w') as f:
+            json.dump({
+                'config' : self.config,
+                'seed' : self.seed,
+                'index' : self.index,
+                'done' : self.done,
+            }, f)
+            f.flush()
+            os.fsync(f.fileno())
+        os.replace(tmp, self.filename)
+
+    def point(self, i=None):
+        """The (delay, duration) of the i-th point (default: the next one)."""
+        if i is None:
+            i = self.index
+        (d_min, d_max) = self.config['delay']
+        (l_min, l_max) = self.config['duration']
+        (u, v) = halton(i, self.shift)
+        return (d_min + int(u * (d_max - d_min)), l_min + int(v * (l_max - l_min)))
+
+    def record(self, delay, duration, result):
+        """Stores the result of the current point and moves on."""
+        self.done.append([int(delay), int(duration), result])
+        self.index += 1
+        self.save()
+
+    def results(self):
+        return [(self.config['waits'], self.config['vid'], d, l, r) for (d, l, r) in self.done]
@@ -25,6 +25,10 @@ class Result:
             '([0-9]+)'      # duration
         '\) => '
         '(running|broken|glitch|success)'  # result
+        '(?: rail '
+            '([0-9]+) '     # minimum rail voltage (mV)
+            '([0-9]+)'      # time below the rail threshold (ns)
+        ')?'
         '\n'
     )
 
@@ -41,6 +45,8 @@ class Result:
         self.delay = int(match[3])
         self.duration = int(match[4])
         self.result = match[5]
+        self.rail_min_mv = int(match[6]) if match[6] else None
+        self.rail_below_ns = int(match[7]) if match[7] else None
 
 def read_from_file(filename, warnings=True):
     with open(filename, 'r') as f:
@@ -0,0 +1,94 @@
+# Copyright (C) 2021 Niklas Jacob
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+# Bisection of a success/failure transition with noisy probes.
+#
+# Every probe of the bisection is decided by a sequential probability ratio
+# test (Wald), which stops as soon as the outcomes are clearly above or
+# below the wanted success rate. Probes far from the transition are decided
+# after a few attempts, only probes close to it need many attempts. A probe
+# that stays undecided after max_tries attempts lies within the transition.
+
+import math
+
+class Sprt:
+    """Tests the success rate p of a probe against p = p_low (mostly
+    failing) and p = p_high (mostly succeeding)."""
+
+    def __init__(self, p_low=.2, p_high=.8, alpha=.05, beta=.05):
+        self.success_llr = math.log(p_high / p_low)
+        self.failure_llr = math.log((1 - p_high) / (1 - p_low))
+        self.upper = math.log((1 - beta) / alpha)
+        self.lower = math.log(beta / (1 - alpha))
+        self.reset()
+
+    def reset(self):
+        self.llr = 0.0
+        self.tries = 0
+        self.successes = 0
+
+    def add(self, success):
+        """Adds an outcome, returns 'high', 'low' or None (undecided)."""
+        self.tries += 1
+        if success:
+            self.successes += 1
+            self.llr += self.success_llr
+        else:
+            self.llr += self.failure_llr
+        return self.decision()
+
+    def decision(self):
+        if self.llr >= self.upper:
+            return 'high'
+        if self.llr <= self.lower:
+            return 'low'
+        return None
+
+def bisect(probe, lo, hi, resolution=1, max_tries=30, max_failures=10, **kwargs):
+    """Finds the transition between lo (mostly succeeding) and hi (mostly
+    failing) of a parameter.
+
+    probe(x) runs one attempt with the parameter x and returns True
+    (success), False (failure) or None (no outcome, is not counted, after
+    max_failures of them in a row a RuntimeError is raised).
+    Further arguments are passed to Sprt.
+
+    Returns (lo, hi, log) with the narrowed interval and the log of the
+    probes (x, successes, tries, decision)."""
+    test = Sprt(**kwargs)
+    log = []
+    while hi - lo > resolution:
+        x = (lo + hi) // 2
+        test.reset()
+        decision = None
+        failures = 0
+        while decision is None and test.tries < max_tries:
+            outcome = probe(x)
+            if outcome is None:
+                failures += 1
+                if failures >= max_failures:
+                    raise RuntimeError(f'No outcome for {x} after {failures} attempts')
+                continue
+            failures = 0
+            decision = test.add(outcome)
+        log.append((x, test.successes, test.tries, decision))
+        if decision == 'high':
+            lo = x
+        elif decision == 'low':
+            hi = x
+        else:
+            # neither mostly succeeding nor mostly failing
+            return (x, x, log)
+    return (lo, hi, log)
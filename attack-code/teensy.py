@@ -15,12 +15,13 @@
 
 import time
 import re
+import zlib
 import serial as pyserial
 
 DEBUG = False
 
 class TeensyClient:
-    def __init__(self, device, baudrate=115200, timeout=2):
+    def __init__(self, device, baudrate=115200, timeout=2, firmware_reset=False, machine=False):
 
         self.device = device
         self.baudrate = baudrate
@@ -35,6 +36,27 @@ class TeensyClient:
         self.glitch_cooldown = None
         self.glitch_repeats = None
         self.attack_waits = None
+        self.attack_reset = None
+
+        # let the firmware reset the target when the attack is armed
+        # (after "restart holdoff" ms, see "restart tune")
+        self.firmware_reset = firmware_reset
+
+        # use the machine mode of the prompt (no echo, status lines)
+        self.machine = machine
+
+        # whether the firmware answered the last command with OK (machine
+        # mode only, None if it isn't known)
+        self.last_status = None
+
+        # messages of other tasks that arrived in between (and lines that
+        # wait_lines didn't consume), the next waits return them first
+        self.unread = []
+
+        # rail measurements of the last glitch (if the rail is sampled)
+        self.last_rail = None
+        # cpu cycles the restore of both rails took in the last attempt
+        self.last_restore = None
 
     def connect(self):
         self.serial = None
@@ -43,8 +65,23 @@ class TeensyClient:
             baudrate = self.baudrate,
             timeout = self.timeout
         )
+        if self.machine:
+            self.set_machine_mode()
         self.clear()
 
+    def set_machine_mode(self) -> bool:
+        # the firmware might already be in machine mode (no echo), so the
+        # reply is searched line by line
+        self.serial.reset_input_buffer()
+        self.serial.write(b'set prompt machine true\r\n')
+        while True:
+            line = self.serial.read_until(b'\r\n')
+            if not line.endswith(b'\r\n'):
+                print(f'Error: machine mode wasn\'t confirmed!\n--> "{line}"')
+                return False
+            if line == b'OK\r\n':
+                return True
+
     def set_timeout(self, timeout):
         if self.timeout:
             if self.timeout == timeout:
@@ -55,6 +92,10 @@ class TeensyClient:
 
     def cmd(self, cmd : str = None, timeout : int = 2) -> bytes:
         self.set_timeout(timeout)
+        self.last_status = None
+
+        if self.machine:
+            return self.__machine_cmd(cmd)
 
         if cmd:
             self.serial.write(cmd.encode() + b'\r\n')
@@ -65,6 +106,15 @@ class TeensyClient:
         if DEBUG:
             print(f"{cmd} --> {res}")
 
+        # other tasks (e.g. the recovery) may print before the command is
+        # executed, these messages (each ended by the prompt) are kept
+        while cmd and res.startswith(b'\r\n') and res.endswith(prompt):
+            message = res[:-len(prompt)]
+            if message.endswith(b'\r\n'):
+                message = message[:-2]
+            self.unread.append(message.decode('ascii', errors='backslashreplace'))
+            res = self.serial.read_until(prompt)
+
         if cmd:
             if not res.startswith(cmd.encode() + b'\r\n'):
                 print(f'Error: teensy didn\'t echo!\n"{cmd}" --> "{res}"')
@@ -81,11 +131,68 @@ class TeensyClient:
         if res.endswith(b'\r\n'):
             res = res[:-2]
 
-        return res.decode('ascii', errors='backslachreplace')
+        return res.decode('ascii', errors='backslashreplace')
+
+    def __machine_cmd(self, cmd : str = None) -> str:
+        # a command (even an empty one) is answered with OK or ERR, the
+        # output in between commands is ended with END
+        if cmd is not None:
+            self.serial.write(cmd.encode() + b'\r\n')
+            status = (b'OK', b'ERR')
+        else:
+            status = (b'END',)
+
+        lines = []
+        while True:
+            line = self.serial.read_until(b'\r\n')
+            if not line.endswith(b'\r\n'):
+                if cmd is not None:
+                    print(f'Error: didn\'t receive status!\n"{cmd}" --> "{lines}"')
+                    return None
+                # timeout
+                break
+            if line[:-2] in status:
+                if cmd is not None:
+                    self.last_status = line[:-2] == b'OK'
+                break
+            if line == b'END\r\n':
+                # output in between commands, not part of the reply
+                if lines:
+                    self.unread.append(b'\r\n'.join(lines).decode('ascii', errors='backslashreplace'))
+                lines = []
+                continue
+            lines.append(line[:-2])
+
+        res = b'\r\n'.join(lines)
+
+        if DEBUG:
+            print(f"{cmd} --> {res}")
+
+        return res.decode('ascii', errors='backslashreplace')
+
+    def __wait_message(self, message : str) -> str:
+        # in machine mode the output doesn't start on a fresh line
+        if self.machine:
+            return message
+        if message.startswith('\r\n'):
+            return message[2:]
+        print('Warning: wait message didn\'t start with CRLF!')
+        return message
+
+    def failed(self) -> bool:
+        """Whether the firmware reported an error for the last command."""
+        if self.last_status is False:
+            print('Error: the firmware answered with ERR!')
+            return True
+        return False
 
     def cmd_expect(self, cmd : str, expected: str, **kwargs) -> bool:
         message = self.cmd(cmd, **kwargs)
 
+        if self.failed():
+            print(f'"{cmd}" --> "{message}"')
+            return False
+
         if message != expected:
             print(f'Error: "{message}" instead of "{expected}"!')
             return False
@@ -93,15 +200,12 @@ class TeensyClient:
         return True
 
     def wait(self, **kwargs) -> str:
+        if self.unread:
+            return self.unread.pop(0)
         return self.cmd(**kwargs)
 
     def wait_expect(self, expected: str, **kwargs) -> bool:
-        message = self.wait(**kwargs)
-
-        if message.startswith('\r\n'):
-            message = message[2:]
-        else:
-            print('Warning: wait message didn\'t start with CRLF!')
+        message = self.__wait_message(self.wait(**kwargs))
 
         if message != expected:
             print(f'Error: "{message}" instead of "{expected}"!')
@@ -116,10 +220,7 @@ class TeensyClient:
             print(f'Error: timeout instead of "{expected}"!')
             return None
 
-        if message.startswith('\r\n'):
-            message = message[2:]
-        else:
-            print('Warning: wait message didn\'t start with CRLF!')
+        message = self.__wait_message(message)
 
         result = expected.match(message)
 
@@ -139,18 +240,45 @@ class TeensyClient:
 
         time.sleep(.2)
 
+        self.unread = []
         return self.cmd_expect('', '')
 
     def set(self, module : str, param : str, value : str, **kwargs) -> bool:
         return self.cmd_expect(f'set {module} {param} {value}', '', **kwargs)
 
-    def wait_for_restart(self, **kwargs) -> bool:
-        if self.wait_expect(
-            'Restart detected!\r\n'
-            'Setting VSoc!\r\n'
-            'Setting VCore and disabling telemetry!',
-            **kwargs
-        ):
+    def wait_lines(self, expected : list, optional=(), message : str = None, **kwargs) -> bool:
+        """Waits for the expected lines (in order), no matter how the
+        firmware's tasks split them into messages. message holds lines
+        that were already received, optional lines may show up anywhere.
+        The lines after the last expected one are left for the next wait."""
+        lines = message.split('\r\n') if message else []
+        pending = list(expected)
+        while pending:
+            if not lines:
+                message = self.wait(**kwargs)
+                if not message:
+                    print(f'Error: timeout instead of "{pending[0]}"!')
+                    return False
+                lines = message.split('\r\n')
+            line = lines.pop(0)
+            if not line or line in optional:
+                continue
+            if line != pending[0]:
+                print(f'Error: "{line}" instead of "{pending[0]}"!')
+                return False
+            pending.pop(0)
+        if any(lines):
+            self.unread.insert(0, ('' if self.machine else '\r\n') + '\r\n'.join(lines))
+        return True
+
+    __restart_lines = [
+        'Restart detected!',
+        'Setting VSoc!',
+        'Setting VCore and disabling telemetry!',
+    ]
+
+    def wait_for_restart(self, optional=(), **kwargs) -> bool:
+        if self.wait_lines(self.__restart_lines, optional, **kwargs):
             self.last_reset = time.time()
             return True
         return False
@@ -159,15 +287,67 @@ class TeensyClient:
         if self.last_reset:
             while time.time() < self.last_reset + 3.0:
                 time.sleep(.1)
-        if not self.cmd_expect('restart reset', 'Resetting target!'):
+        message = self.cmd('restart reset')
+        if message is None or self.failed():
             return False
-        if not self.wait_expect('Target is now offline!'):
+        # the reset serves a pending recovery, its earlier messages are stale
+        self.unread = []
+        if not self.wait_lines(['Resetting target!', 'Target is now offline!'], message=message):
             return False
         return self.wait_for_restart(**kwargs)
 
+    def wait_for_reset(self, **kwargs) -> bool:
+        # The firmware waits up to "restart holdoff" ms before resetting.
+        # After a broken result the recovery reset (restart recover) serves
+        # the attack, it may already have been reported before arming.
+        kwargs.setdefault('timeout', 10)
+        return self.wait_for_restart(
+            optional=('Resetting target!', 'Target is now offline!'), **kwargs
+        )
+
     def arm_glitch(self, **kwargs) -> bool:
         return self.cmd_expect('glitch arm', 'Glitch armed!', **kwargs)
 
+    def export_config(self, **kwargs) -> str:
+        """The configuration record of the firmware (see "help config")."""
+        record = self.cmd('config export', **kwargs)
+        if self.failed() or not record or '#' not in record:
+            print(f'Error: "{record}" isn\'t a configuration record!')
+            return None
+        (body, crc) = record.rsplit('#', 1)
+        if int(crc, 16) != zlib.crc32(body.encode()):
+            print(f'Error: the checksum of "{record}" doesn\'t match!')
+            return None
+        return record
+
+    __config_re = re.compile(
+        'changed = (0x[0-9a-f]+)\r\n'
+        'Configuration imported!'
+    )
+
+    def import_config(self, record : str, **kwargs) -> int:
+        """Applies a record (the checksum is added if it has none), returns
+        how many parameters were changed (None on error)."""
+        if '#' not in record:
+            record = f'{record}#0x{zlib.crc32(record.encode()):08x}'
+        message = self.cmd(f'config import {record}', **kwargs)
+        match = self.__config_re.match(message or '')
+        if self.failed() or not match:
+            print(f'Error: "{message}" instead of "Configuration imported!"!')
+            return None
+        return int(match[1], 16)
+
+    def check_config(self, **kwargs) -> bool:
+        """Whether the exported configuration imports back unchanged."""
+        record = self.export_config(**kwargs)
+        if record is None:
+            return False
+        changed = self.import_config(record, **kwargs)
+        if changed != 0:
+            print(f'Error: the exported configuration changed 0x{changed or 0:x} parameters!')
+            return False
+        return True
+
     def arm_attack(self, **kwargs) -> bool:
         return self.cmd_expect('attack', 'Attack armed!', **kwargs)
 
@@ -187,6 +367,38 @@ class TeensyClient:
     def wait_for_attack(self, **kwargs) -> str:
         return self.wait_match(self.__attack_re, **kwargs)
 
+    __rail_re = re.compile(
+        'Rail: min = 0x([0-9a-f]+) mV, below = 0x([0-9a-f]+) ns'
+    )
+
+    __rail_wave_re = re.compile(
+        'Rail: 0x[0-9a-f]+ points every 0x([0-9a-f]+) ns \\(mV\\):((?: 0x[0-9a-f]+)*)'
+    )
+
+    __restore_re = re.compile(
+        'Restore: 0x([0-9a-f]+) cycles'
+    )
+
+    def parse_restore(self, message : str) -> int:
+        match = self.__restore_re.search(message)
+        return int(match[1], 16) if match else None
+
+    def parse_rail(self, message : str) -> dict:
+        match = self.__rail_re.search(message)
+        if not match:
+            return None
+        rail = {
+            'min_mv' : int(match[1], 16),
+            'below_ns' : int(match[2], 16),
+            'point_ns' : None,
+            'waveform_mv' : [],
+        }
+        match = self.__rail_wave_re.search(message)
+        if match:
+            rail['point_ns'] = int(match[1], 16)
+            rail['waveform_mv'] = [int(v, 16) for v in match[2].split()]
+        return rail
+
     def glitch(self,
         vid : int,
         delay : int,
@@ -229,6 +441,9 @@ class TeensyClient:
         if not match:
             return None
 
+        self.last_rail = self.parse_rail(match.string)
+        self.last_restore = self.parse_restore(match.string)
+
         return {
             'continues running' : 'running',
             'glitched successfully' : 'glitch',
@@ -269,16 +484,30 @@ class TeensyClient:
                 return None
             self.glitch_cooldown = cooldown
 
+        if self.attack_reset != self.firmware_reset:
+            if not self.set('attack', 'reset', str(self.firmware_reset).lower(), **kwargs):
+                return None
+            self.attack_reset = self.firmware_reset
+
         if not self.arm_attack(**kwargs):
             return None
+        # only the reset after arming is waited for
+        self.unread = []
 
-        self.reset_target(**kwargs)
+        if self.firmware_reset:
+            if not self.wait_for_reset(**kwargs):
+                return None
+        elif not self.reset_target(**kwargs):
+            return None
 
         match = self.wait_for_attack(**kwargs)
 
         if not match:
             return None
 
+        self.last_rail = self.parse_rail(match.string)
+        self.last_restore = self.parse_restore(match.string)
+
         return {
             'continues running' : 'running',
             'glitched successfully' : 'success',
@@ -298,6 +527,7 @@ class GlitchSetup:
     def start(self):
         self.teensy.connect()
         self.teensy.wait()
+        self.teensy.check_config()
         print(self.teensy.cmd(f'set hw config {self.hw_cfg}'))
         if self.use_core:
             print(self.teensy.cmd(f'set glitch set_soc false'))
@@ -342,7 +572,77 @@ class GlitchSetup:
             result = self.attack(waits, vid, delay, duration, **kwargs)
 
             if result:
-                print(f'({waits}, {vid}, {delay}, {duration}) => {result}')
+                rail = self.teensy.last_rail
+                if rail:
+                    print(f'({waits}, {vid}, {delay}, {duration}) => {result}'
+                        f' rail {rail["min_mv"]} {rail["below_ns"]}')
+                else:
+                    print(f'({waits}, {vid}, {delay}, {duration}) => {result}')
                 if exit_on_success:
                     if result[0] == 'success':
                         return 'success'
+
+    def campaign(self, filename, count, waits, vid, delay_min, delay_max, dur_min, dur_max, seed=None, exit_on_success=False, **kwargs):
+
+        from campaign import Campaign
+        c = Campaign(filename, waits, vid, delay_min, delay_max, dur_min, dur_max, seed)
+
+        if c.index:
+            print(f'Resuming {filename} at point {c.index}')
+
+        failures = 0
+
+        self.teensy.clear()
+        while c.index < count:
+
+            (delay, duration) = c.point()
+
+            result = self.attack(waits, vid, delay, duration, **kwargs)
+
+            # failed attempts are repeated with the same point
+            if not result:
+                failures += 1
+                if failures >= 10:
+                    print('Error: Too many failed attempts, stopping the campaign!')
+                    return None
+                self.teensy.clear()
+                continue
+            failures = 0
+
+            c.record(delay, duration, result)
+
+            rail = self.teensy.last_rail
+            if rail:
+                print(f'({waits}, {vid}, {delay}, {duration}) => {result}'
+                    f' rail {rail["min_mv"]} {rail["below_ns"]}')
+            else:
+                print(f'({waits}, {vid}, {delay}, {duration}) => {result}')
+
+            if exit_on_success and result == 'success':
+                return 'success'
+
+    def bisect_duration(self, waits, vid, delay, dur_min, dur_max, resolution=8, max_tries=30, **kwargs):
+        """Finds the duration between dur_min (mostly successful attempts)
+        and dur_max (mostly broken attempts) where the outcome flips."""
+
+        import sprt
+
+        def probe(duration):
+            result = self.attack(waits, vid, delay, duration, **kwargs)
+            if result:
+                print(f'({waits}, {vid}, {delay}, {duration}) => {result}')
+            else:
+                self.teensy.clear()
+            if result not in ['success', 'broken']:
+                return None
+            return result == 'success'
+
+        self.teensy.clear()
+        (lo, hi, log) = sprt.bisect(probe, dur_min, dur_max, resolution, max_tries)
+
+        print(' duration | success/try')
+        print('----------|-------------')
+        for (duration, successes, tries, decision) in log:
+            print(f'{duration:9} | {successes}/{tries}')
+
+        return (lo, hi)
@@ -17,6 +17,7 @@
 #define AMD_SVI2_HPP
 
 #include "io.h"
+#include "trace.h"
 
 #include "teensy_pins.hpp"
 #include "teensy_twi.hpp"
@@ -45,7 +46,34 @@ struct CommandRaw {
     }
 
     int send(Twi::Master &master, uint32_t timeout) {
-        return master.send_u16(address, data, timeout);
+        trace_event(trace_packet, to_wire());
+        int rc = master.send_u16(address, data, timeout);
+        trace_event(trace_packet, TraceNone);
+        if (rc < 0)
+            trace_event(trace_error, -rc);
+        return rc;
+    }
+
+    // Sends both packets in one burst (see Twi::Master::queue_u16)
+    static int send_pair(Twi::Master &master, const CommandRaw &first, const CommandRaw &second, uint32_t timeout) {
+        trace_event(trace_packet, first.to_wire());
+        int rc = master.start_u16(first.address, first.data, timeout);
+        if (rc >= 0) rc = master.queue_u16(second.address, second.data, timeout);
+        if (rc >= 0) {
+            // the second packet is queued once the first one went out
+            trace_event(trace_packet, second.to_wire());
+            rc = master.finish(timeout);
+        }
+        trace_event(trace_packet, TraceNone);
+        if (rc < 0)
+            trace_event(trace_error, -rc);
+        return rc;
+    }
+
+    // the three bytes as they appear on the bus, address byte first
+    // (including the write bit)
+    uint32_t to_wire() const {
+        return ((uint32_t) address << 17) | ((data & 0xff) << 8) | (data >> 8);
     }
 
     void print(const char* name = "CommandRaw") const {
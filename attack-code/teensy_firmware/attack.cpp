@@ -13,17 +13,70 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
+#include <core_pins.h>
+
 #include "prompt.h"
 #include "amd_cmds.h"
 
 #include "attack.h"
 #include "restart.h"
 #include "glitch.h"
+#include "timing.h"
+#include "stats.h"
+#include "trace.h"
+
+uint8_t  attack_trigger      = DefaultAttackTrigger;
+uint32_t attack_waits        = DefaultAttackWaits;
+bool     attack_reset        = DefaultAttackReset;
+uint32_t attack_addr         = DefaultAttackAddr;
+uint32_t attack_addr_len     = DefaultAttackAddrLen;
+uint32_t attack_addr_waits   = DefaultAttackAddrWaits;
+uint32_t attack_addr_timeout = DefaultAttackAddrTimeout;
+uint32_t attack_calib_boots  = DefaultAttackCalibBoots;
+uint32_t attack_calib_holdoff= DefaultAttackCalibHoldoff;
+uint32_t attack_sweep_start  = DefaultAttackSweepStart;
+uint32_t attack_sweep_bin    = DefaultAttackSweepBin;
+uint32_t attack_sweep_bins   = DefaultAttackSweepBins;
+
+cli_param_u32 attack_waits_this         = make_cli_param_u32(attack_waits,          DefaultAttackWaits,         0, 0xffffffff);
+cli_param_u32 attack_addr_this          = make_cli_param_u32(attack_addr,           DefaultAttackAddr,          0, 0xffffff);
+cli_param_u32 attack_addr_len_this      = make_cli_param_u32(attack_addr_len,       DefaultAttackAddrLen,       1, 0x1000000);
+cli_param_u32 attack_addr_waits_this    = make_cli_param_u32(attack_addr_waits,     DefaultAttackAddrWaits,     0, 0xffffffff);
+cli_param_u32 attack_addr_timeout_this  = make_cli_param_u32(attack_addr_timeout,   DefaultAttackAddrTimeout,   0, 0xffffffff);
+cli_param_u32 attack_calib_boots_this   = make_cli_param_u32(attack_calib_boots,    DefaultAttackCalibBoots,    1, AttackMaxCalibBoots);
+cli_param_u32 attack_calib_holdoff_this = make_cli_param_u32(attack_calib_holdoff,  DefaultAttackCalibHoldoff,  0, 0xffffffff);
+cli_param_u32 attack_sweep_start_this   = make_cli_param_u32(attack_sweep_start,    DefaultAttackSweepStart,    0, 0xffffffff);
+cli_param_u32 attack_sweep_bin_this     = make_cli_param_u32(attack_sweep_bin,      DefaultAttackSweepBin,      1, 0xffff);
+cli_param_u32 attack_sweep_bins_this    = make_cli_param_u32(attack_sweep_bins,     DefaultAttackSweepBins,     1, AttackMaxSweepBins);
+
+cli_param_bool attack_reset_this        = make_cli_param_bool(attack_reset, DefaultAttackReset);
+
+cli_param attack_reset_param        = make_cli_param_bool_param("reset",        attack_reset_desc,          attack_reset_this,          0);
+cli_param attack_sweep_bins_param   = make_cli_param_u32_param("sweep_bins",    attack_sweep_bins_desc,     attack_sweep_bins_this,     &attack_reset_param);
+cli_param attack_sweep_bin_param    = make_cli_param_u32_param("sweep_bin",     attack_sweep_bin_desc,      attack_sweep_bin_this,      &attack_sweep_bins_param);
+cli_param attack_sweep_start_param  = make_cli_param_u32_param("sweep_start",   attack_sweep_start_desc,    attack_sweep_start_this,    &attack_sweep_bin_param);
+cli_param attack_calib_holdoff_param= make_cli_param_u32_param("calib_holdoff", attack_calib_holdoff_desc,  attack_calib_holdoff_this,  &attack_sweep_start_param);
+cli_param attack_calib_boots_param  = make_cli_param_u32_param("calib_boots",   attack_calib_boots_desc,    attack_calib_boots_this,    &attack_calib_holdoff_param);
+cli_param attack_addr_timeout_param = make_cli_param_u32_param("addr_timeout",  attack_addr_timeout_desc,   attack_addr_timeout_this,   &attack_calib_boots_param);
+cli_param attack_addr_waits_param   = make_cli_param_u32_param("addr_waits",    attack_addr_waits_desc,     attack_addr_waits_this,     &attack_addr_timeout_param);
+cli_param attack_addr_len_param     = make_cli_param_u32_param("addr_len",      attack_addr_len_desc,       attack_addr_len_this,       &attack_addr_waits_param);
+cli_param attack_addr_param         = make_cli_param_u32_param("addr",          attack_addr_desc,           attack_addr_this,           &attack_addr_len_param);
+
+bool attack_trigger_set(void * pThis, const char *value, unsigned n);
+bool attack_trigger_reset(void * pThis);
+bool attack_trigger_print(void *pThis);
 
-uint32_t attack_waits = DefaultAttackWaits;
+cli_param attack_trigger_param = {
+    .name           = "trigger",
+    .description    = attack_trigger_desc,
+    .pThis          = 0,
+    .set            = attack_trigger_set,
+    .reset          = attack_trigger_reset,
+    .print          = attack_trigger_print,
+    .next           = &attack_addr_param,
+};
 
-cli_param_u32 attack_waits_this = make_cli_param_u32(attack_waits, DefaultAttackWaits, 0, 0xffffffff);
-cli_param attack_waits_param = make_cli_param_u32_param("waits", attack_waits_desc, attack_waits_this, 0);
+cli_param attack_waits_param = make_cli_param_u32_param("waits", attack_waits_desc, attack_waits_this, &attack_trigger_param);
 
 bool attack_armed = false;
 bool attack_was_off = false;
@@ -32,15 +85,95 @@ bool attack_arm(void * pThis) {
     attack_armed = true;
     attack_was_off = false;
     println("Attack armed!");
+    if (attack_reset)
+        restart_request_reset();
+    return true;
+}
+
+// measurement (calibration and sweep) state
+enum attack_measurement : uint8_t {
+    attack_measure_none,
+    attack_measure_calib,
+    attack_measure_sweep,
+};
+
+uint8_t  attack_measuring = attack_measure_none;
+uint32_t attack_measure_done = 0;
+bool     attack_measure_reset_pending = false;
+uint32_t attack_measure_reset_at = 0;
+
+// (the results aren't per target, measurements need a single target)
+uint32_t attack_calib_counts[AttackMaxCalibBoots];
+
+// per sampled delay: in how many boots chip-select was low
+uint8_t  attack_sweep_lows[AttackMaxSweepBins];
+uint32_t attack_sweep_cycles_per_1024 = 0;
+
+hw_target_var attack_measure_reset_at_var   = make_hw_target_var(attack_measure_reset_at,       0);
+hw_target_var attack_measure_reset_pending_var = make_hw_target_var(attack_measure_reset_pending, &attack_measure_reset_at_var);
+hw_target_var attack_measure_done_var       = make_hw_target_var(attack_measure_done,           &attack_measure_reset_pending_var);
+hw_target_var attack_measuring_var          = make_hw_target_var(attack_measuring,              &attack_measure_done_var);
+hw_target_var attack_was_off_var            = make_hw_target_var(attack_was_off,                &attack_measuring_var);
+hw_target_var attack_target_vars            = make_hw_target_var(attack_armed,                  &attack_was_off_var);
+
+void attack_measure_start(uint8_t measurement) {
+    attack_armed = false;
+    attack_measuring = measurement;
+    attack_measure_done = 0;
+    attack_measure_reset_pending = false;
+    attack_was_off = false;
+    println("Resetting target!");
+    restart_reset_target();
+}
+
+bool attack_measure_single_target() {
+    if (hw_targets == 1) return true;
+    println("Error: Calibration and sweep need a single target (hw config 1 or 2)!");
+    return false;
+}
+
+bool attack_calibrate(void * pThis) {
+    if (!attack_measure_single_target())
+        return false;
+    println("Calibration started!");
+    attack_measure_start(attack_measure_calib);
     return true;
 }
 
+bool attack_sweep(void * pThis) {
+    if (!attack_measure_single_target())
+        return false;
+    for (uint32_t i = 0; i < attack_sweep_bins; i++)
+        attack_sweep_lows[i] = 0;
+    // the delays are timed with the cycle counter
+    attack_sweep_cycles_per_1024 = hw_busy_loop_cycles_per_1024();
+    println("Sweep started!");
+    attack_measure_start(attack_measure_sweep);
+    return true;
+}
+
+cli_command attack_sweep_cmd = {
+    .name           = "sweep",
+    .description    = attack_sweep_cmd_desc,
+    .pThis          = 0,
+    .exec           = &attack_sweep,
+    .next           = 0,
+};
+
+cli_command attack_calibrate_cmd = {
+    .name           = "calibrate",
+    .description    = attack_calibrate_cmd_desc,
+    .pThis          = 0,
+    .exec           = &attack_calibrate,
+    .next           = &attack_sweep_cmd,
+};
+
 cli_command attack_arm_cmd = {
     .name           = "",
     .description    = attack_cmd_desc,
     .pThis          = 0,
     .exec           = &attack_arm,
-    .next           = 0,
+    .next           = &attack_calibrate_cmd,
 };
 
 cli_module attack_module = {
@@ -51,10 +184,280 @@ cli_module attack_module = {
     .next           = 0,
 };
 
-void attack_process_trigger() {
+bool attack_failed(const char * error, uint32_t code) {
+    prompt_use_new_line();
+    if (attack_measuring == attack_measure_sweep)
+        println("Sweep failed!");
+    else
+        println("Attack failed!");
+    println(error);
+    trace_event(trace_error, code);
+    return false;
+}
 
-    if (!attack_armed) return;
-    // Attack armed
+// Expects chip-select to be low (a pulse has started) and returns
+// at the beginning of the waits-th following chip-select low-pulse.
+template <class PINS>
+FASTRUN bool attack_wait_cs_pulses_on(uint32_t waits) {
+
+    typename PINS::cs_pin cs_pin;
+
+    // longest examples found were 33 us (low) and 15 us (high)
+    const uint32_t low_timeout = timing_timeout(timing_cs_low, rough_busy_wait_us(100));
+    const uint32_t high_timeout = timing_timeout(timing_cs_high, rough_busy_wait_us(50));
+
+    uint32_t timeout;
+
+    for (uint32_t i = 0; i < waits; i++) {
+
+        // the gap before this pulse (the last gap ends at the glitch
+        // trigger and isn't recorded to keep it on time)
+        if (i > 0)
+            timing_record(timing_cs_high, high_timeout - timeout);
+
+        // (the timeouts cover the whole pulse and gap, a short glitch of
+        // the pin only continues the wait)
+        timeout = low_timeout;
+        do {
+            BUSY_LOOP_WHILE_PIN_LOW(attack_cs_low, timeout, cs_pin);
+        } while (timeout && cs_pin.is_low() && cs_pin.is_low());
+        hw_trigger_set_low<PINS>(hw_trigger_attack, trace_attack);
+        trace_event(trace_cs, 1);
+
+        if (timeout == 0)
+            return attack_failed("Error: CS was low for too long!", attack_error_cs_low);
+        timing_record(timing_cs_low, low_timeout - timeout);
+
+        timeout = high_timeout;
+        do {
+            BUSY_LOOP_WHILE_PIN_HIGH(attack_cs_high, timeout, cs_pin);
+        } while (timeout && cs_pin.is_high() && cs_pin.is_high());
+        hw_trigger_set_high<PINS>(hw_trigger_attack, trace_attack);
+        trace_event(trace_cs, 0);
+
+        if (timeout == 0) {
+            hw_trigger_set_low<PINS>(hw_trigger_attack, trace_attack);
+            return attack_failed("Error: CS was high for too long!", attack_error_cs_high);
+        }
+
+    }
+
+    return true;
+}
+
+bool attack_wait_cs_pulses(uint32_t waits) {
+    return HW_PINS_CALL(attack_wait_cs_pulses_on, waits);
+}
+
+// Returns during the flash read of the configured address range.
+bool attack_wait_addr() {
+
+    if (!hw_spi_enabled) {
+        hw_trigger_attack_set_low();
+        return attack_failed("Error: The spi sniffer is off (hw config both)!", attack_error_sniffer_off);
+    }
+
+    // drop frames of earlier flash accesses
+    spi_sniffer.clear();
+
+    int rc = spi_sniffer.wait_for_read(
+        attack_addr,
+        attack_addr + attack_addr_len - 1,
+        attack_addr_timeout
+    );
+
+    if (rc == -1) {
+        hw_trigger_attack_set_low();
+        return attack_failed("Error: The flash address range wasn't read!", attack_error_addr_unread);
+    }
+    if (rc < 0) {
+        hw_trigger_attack_set_low();
+        return attack_failed("Error: The spi sniffer lost frames!", attack_error_frames_lost);
+    }
+
+    return true;
+}
+
+// Expects chip-select to be low (a pulse has started) and counts the
+// following chip-select low-pulses until chip-select stays high.
+// Returns false if chip-select was low for too long.
+// The pulse widths and gaps are recorded for the timing module.
+template <class PINS>
+FASTRUN bool attack_count_cs_pulses_on(uint32_t &count) {
+
+    typename PINS::cs_pin cs_pin;
+
+    constexpr uint32_t low_timeout = rough_busy_wait_us(100);
+    constexpr uint32_t high_timeout = rough_busy_wait_us(50);
+
+    uint32_t timeout;
+
+    for (count = 0; ; count++) {
+
+        timeout = low_timeout;
+        BUSY_LOOP_WHILE_PIN_LOW(attack_count_low, timeout, cs_pin);
+        if (timeout == 0)
+            return false;
+        trace_event(trace_cs, 1);
+        timing_record(timing_cs_low, low_timeout - timeout);
+
+        timeout = high_timeout;
+        BUSY_LOOP_WHILE_PIN_HIGH(attack_count_high, timeout, cs_pin);
+        if (timeout == 0)
+            return true;
+        trace_event(trace_cs, 0);
+        timing_record(timing_cs_high, high_timeout - timeout);
+    }
+}
+
+bool attack_count_cs_pulses(uint32_t &count) {
+    return HW_PINS_CALL(attack_count_cs_pulses_on, count);
+}
+
+void attack_print_calibration() {
+
+    uint32_t min = 0xffffffff, max = 0;
+    for (uint32_t i = 0; i < attack_measure_done; i++) {
+        if (attack_calib_counts[i] < min) min = attack_calib_counts[i];
+        if (attack_calib_counts[i] > max) max = attack_calib_counts[i];
+    }
+
+    println("Calibration done!");
+    println("pulses     | boots");
+    println("-----------|-----------");
+    for (uint32_t v = min; v <= max; v++) {
+        uint32_t n = 0;
+        for (uint32_t i = 0; i < attack_measure_done; i++)
+            if (attack_calib_counts[i] == v) n++;
+        if (n == 0) continue;
+        print_hex_int(v);
+        print_str(" | ");
+        print_hex_int(n);
+        println();
+    }
+
+    if (min == 0) {
+        println("Error: A boot had no chip-select pulses to wait for!");
+        return;
+    }
+
+    attack_waits = min - 1;
+    print_hex_param("attack waits", attack_waits, int);
+}
+
+// Expects chip-select to be low (the first pulse after the restart)
+// and returns when the glitch delay starts.
+bool attack_wait_trigger() {
+
+    uint32_t waits = attack_waits;
+
+    if (attack_trigger == attack_trigger_addr) {
+        if (!attack_wait_addr())
+            return false;
+        waits = attack_addr_waits;
+    }
+
+    return attack_wait_cs_pulses(waits);
+}
+
+uint32_t attack_sweep_delay(uint32_t bin) {
+    return attack_sweep_start + bin * attack_sweep_bin;
+}
+
+// Samples chip-select at every sweep delay after the trigger.
+bool attack_sweep_boot() {
+
+    if (!attack_wait_trigger())
+        return false;
+    hw_trigger_attack_set_low();
+
+    uint32_t start = ARM_DWT_CYCCNT;
+    for (uint32_t i = 0; i < attack_sweep_bins; i++) {
+        uint64_t at = ((uint64_t) attack_sweep_delay(i) * attack_sweep_cycles_per_1024) >> 10;
+        // the cycle counter overflows after ~7s
+        if (at >= 0x80000000)
+            break;
+        while (ARM_DWT_CYCCNT - start < at);
+        if (hw.cs_pin.is_low())
+            attack_sweep_lows[i]++;
+    }
+
+    return true;
+}
+
+void attack_print_sweep_edge(const char * name, uint32_t a, uint32_t b) {
+    print_str(name);
+    print_str(" edge between ");
+    print_hex_int(attack_sweep_delay(a));
+    print_str(" and ");
+    print_hex_int(attack_sweep_delay(b));
+    println();
+}
+
+void attack_print_sweep() {
+
+    uint32_t boots = attack_measure_done;
+    uint32_t bins = attack_sweep_bins;
+
+    println("Sweep done!");
+    println("delay      | CS low in boots");
+    println("-----------|-----------");
+    for (uint32_t i = 0; i < bins; i++) {
+        if (i > 0 && attack_sweep_lows[i] == attack_sweep_lows[i-1])
+            continue;
+        print_hex_int(attack_sweep_delay(i));
+        print_str(" | ");
+        print_hex_int(attack_sweep_lows[i]);
+        println();
+    }
+
+    // the window is the longest run of delays where chip-select
+    // was high in every boot
+    uint32_t first = 0, len = 0;
+    for (uint32_t i = 0, n = 0; i < bins; i++) {
+        n = attack_sweep_lows[i] ? 0 : n + 1;
+        if (n > len) {
+            len = n;
+            first = i + 1 - n;
+        }
+    }
+    if (len == 0) {
+        println("Error: Chip-select was low at every delay!");
+        return;
+    }
+    uint32_t last = first + len - 1;
+
+    // An edge of the window lies between the window and the nearest delay
+    // where chip-select was low in every boot, the delays in between
+    // (low in some boots) show the jitter of the edge.
+    if (first == 0) {
+        println("Window start not found (chip-select was high at sweep_start)!");
+    } else {
+        uint32_t lo = first - 1;
+        while (lo > 0 && attack_sweep_lows[lo] < boots) lo--;
+        attack_print_sweep_edge("Window start:", lo, first);
+    }
+    if (last == bins - 1) {
+        println("Window end not found (chip-select was high at the last delay)!");
+    } else {
+        uint32_t hi = last + 1;
+        while (hi < bins - 1 && attack_sweep_lows[hi] < boots) hi++;
+        attack_print_sweep_edge("Window end:  ", last, hi);
+    }
+
+    print_hex_param("delay_min", attack_sweep_delay(first), int);
+    print_hex_param("delay_max", attack_sweep_delay(last), int);
+}
+
+void attack_process_measurement() {
+
+    if (attack_measure_reset_pending) {
+        if ((int32_t) (millis() - attack_measure_reset_at) < 0) return;
+        attack_measure_reset_pending = false;
+        attack_was_off = false;
+        restart_reset_target();
+        return;
+    }
 
     if (!attack_was_off) {
         if (restart_is_off())
@@ -64,48 +467,76 @@ void attack_process_trigger() {
 
     if (hw.cs_pin.is_high() || hw.cs_pin.is_high()) return;
 
-    // Attack triggered
+    hw_critical_begin();
     hw_trigger_attack_set_high();
-    attack_armed = false;
-
-    uint32_t timeout;
 
-    for (uint32_t i = 0; i < attack_waits; i++) {
+    if (attack_measuring == attack_measure_calib) {
 
-        // longest example found was 33 us
-        timeout = rough_busy_wait_us(100);
-        do {
-            BUSY_LOOP_WHILE_PIN_LOW(attack_cs_low, timeout, hw.cs_pin);
-        } while (hw.cs_pin.is_low() && hw.cs_pin.is_low());
+        uint32_t count;
+        bool ok = attack_count_cs_pulses(count);
         hw_trigger_attack_set_low();
+        hw_critical_end();
 
-        if (timeout == 0) {
-            prompt_use_new_line();
-            println("Attack failed!");
+        prompt_use_new_line();
+        if (!ok) {
+            attack_measuring = attack_measure_none;
+            println("Calibration failed!");
             println("Error: CS was low for too long!");
             return;
         }
 
-        // longest example found was 15 us
-        do {
-            timeout = rough_busy_wait_us(50);
-            BUSY_LOOP_WHILE_PIN_HIGH(attack_cs_high, timeout, hw.cs_pin);
-        } while (hw.cs_pin.is_high() && hw.cs_pin.is_high());
-        hw_trigger_attack_set_high();
+        attack_calib_counts[attack_measure_done++] = count;
+        print_str("Boot ");
+        print_hex_byte(attack_measure_done);
+        print_str(": ");
+        print_hex_int(count);
+        println(" pulses");
 
-        if (timeout == 0) {
-            hw_trigger_attack_set_low();
-            prompt_use_new_line();
-            println("Attack failed!");
-            println("Error: CS was high for too long!");
+    } else {
+
+        bool ok = attack_sweep_boot();
+        hw_critical_end();
+
+        if (!ok) {
+            attack_measuring = attack_measure_none;
             return;
         }
 
+        prompt_use_new_line();
+        attack_measure_done++;
+        print_str("Boot ");
+        print_hex_byte(attack_measure_done);
+        println(" sampled");
     }
+
+    if (attack_measure_done < attack_calib_boots) {
+        attack_measure_reset_pending = true;
+        attack_measure_reset_at = millis() + attack_calib_holdoff;
+        return;
+    }
+
+    if (attack_measuring == attack_measure_calib)
+        attack_print_calibration();
+    else
+        attack_print_sweep();
+    attack_measuring = attack_measure_none;
+}
+
+// Expects chip-select to be low (the first pulse after the restart).
+void attack_run() {
+
+    hw_trigger_attack_set_high();
+    attack_armed = false;
+
+    uint32_t wait_start = ARM_DWT_CYCCNT;
+    if (!attack_wait_trigger())
+        return;
+    uint32_t wait_cycles = ARM_DWT_CYCCNT - wait_start;
     hw_trigger_attack_set_low();
 
     // Glitch now
     glitch_result result = glitch();
+    stats_record(stats_wait, wait_cycles);
 
     prompt_use_new_line();
     println("Attack triggered!");
@@ -115,4 +546,59 @@ void attack_process_trigger() {
 
 }
 
+void attack_process_trigger() {
 
+    if (attack_measuring != attack_measure_none) {
+        attack_process_measurement();
+        return;
+    }
+
+    if (!attack_armed) return;
+    // Attack armed
+
+    if (!attack_was_off) {
+        if (restart_is_off())
+            attack_was_off = true;
+        return;
+    }
+
+    if (hw.cs_pin.is_high() || hw.cs_pin.is_high()) return;
+
+    // Attack triggered
+    hw_critical_begin();
+    attack_run();
+    hw_critical_end();
+}
+
+bool attack_trigger_set(void * pThis, const char *value, unsigned n) {
+    if (str_cmp(value, n, "cs", sizeof("cs")) == 0) {
+        attack_trigger = attack_trigger_cs;
+        return true;
+    }
+    if (str_cmp(value, n, "addr", sizeof("addr")) == 0) {
+        attack_trigger = attack_trigger_addr;
+        return true;
+    }
+    println("Error: Couldn't parse value, use cs or addr!");
+    return false;
+}
+
+bool attack_trigger_reset(void * pThis) {
+    attack_trigger = DefaultAttackTrigger;
+    return true;
+}
+
+bool attack_trigger_print(void * pThis) {
+    switch (attack_trigger) {
+        case attack_trigger_cs:
+            print_str("cs");
+            break;
+        case attack_trigger_addr:
+            print_str("addr");
+            break;
+        default:
+            print_str("unknown (this should never happen)");
+            return false;
+    }
+    return true;
+}
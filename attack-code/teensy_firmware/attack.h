@@ -20,7 +20,42 @@
 #include "cli.h"
 
 
-constexpr uint32_t DefaultAttackWaits = 20;
+// why an attack failed (the trace error, above the negated twi return codes)
+enum attack_error : uint32_t {
+    attack_error_cs_low         = 0x100,
+    attack_error_cs_high,
+    attack_error_sniffer_off,
+    attack_error_addr_unread,
+    attack_error_frames_lost,
+};
+
+enum attack_trigger_mode : uint8_t {
+    attack_trigger_cs,
+    attack_trigger_addr,
+};
+
+constexpr uint8_t  DefaultAttackTrigger     = attack_trigger_cs;
+
+constexpr uint32_t DefaultAttackWaits       = 20;
+
+constexpr bool     DefaultAttackReset       = false;
+
+// pubkey_offset and pubkey_length of make_epyc3_pl.py
+constexpr uint32_t DefaultAttackAddr        = 0x66400;
+constexpr uint32_t DefaultAttackAddrLen     = 0x440;
+constexpr uint32_t DefaultAttackAddrWaits   = 0;
+constexpr uint32_t DefaultAttackAddrTimeout = rough_busy_wait_ms(100);
+
+// calibration of the waits parameter
+constexpr uint32_t AttackMaxCalibBoots      = 32;
+constexpr uint32_t DefaultAttackCalibBoots  = 5;
+constexpr uint32_t DefaultAttackCalibHoldoff= 3000; // ms
+
+// sweep of the delay window
+constexpr uint32_t AttackMaxSweepBins       = 256;
+constexpr uint32_t DefaultAttackSweepStart  = 0;
+constexpr uint32_t DefaultAttackSweepBin    = 32;
+constexpr uint32_t DefaultAttackSweepBins   = AttackMaxSweepBins;
 
 void attack_process_trigger();
 
@@ -30,9 +65,62 @@ void attack_process_trigger();
     "The glitch module will be used to carry out the actual attack."
 #define attack_cmd_desc \
     "Arms the attack, it will be performed when the next restart is detected."
+#define attack_calibrate_cmd_desc \
+    "Counts the chip-select low-pulses of calib_boots many boots (the\r\n" \
+    "target is reset for every boot and no glitch is injected). Prints\r\n" \
+    "their distribution and sets waits to one less than the lowest count.\r\n" \
+    "Note: This only works with a firmware image whose ARK verification\r\n" \
+    "      fails (the boot has to stop at the ARK verification) and not\r\n" \
+    "      with \"hw config both\"."
+#define attack_sweep_cmd_desc \
+    "Samples the chip-select line of calib_boots many boots at the delays\r\n" \
+    "sweep_start + i * sweep_bin (for i < sweep_bins, in glitch delay units)\r\n" \
+    "after the trigger (the target is reset for every boot and no glitch\r\n" \
+    "is injected). Prints in how many boots chip-select was low per delay\r\n" \
+    "and the window in which it was high in every boot (ARK verification).\r\n" \
+    "Note: The end of the window can only be found with the original\r\n" \
+    "      firmware image (the boot has to continue after the ARK). Like\r\n" \
+    "      calibrate, it doesn't work with \"hw config both\"."
+#define attack_reset_desc \
+    "Whether arming the attack also resets the target (as soon as\r\n" \
+    "\"restart holdoff\" ms have passed since the last reset)."
 #define attack_waits_desc \
     "The specified amount of chip-select low-pulses will be waited for,\r\n" \
     "before the glitch will be triggered."
+#define attack_trigger_desc \
+    "How the glitch is triggered after the restart was detected:\r\n" \
+    "  cs   -> after waits many chip-select low-pulses\r\n" \
+    "  addr -> when the flash is read at an address between addr and\r\n" \
+    "          addr + addr_len - 1 (and after addr_waits many further\r\n" \
+    "          chip-select low-pulses)\r\n" \
+    "Note: The addr trigger needs the spi clock and mosi lines (see\r\n" \
+    "      \"help hw config\") and only decodes read commands whose\r\n" \
+    "      address is sent on a single data line."
+#define attack_addr_desc \
+    "The first flash address of the range watched by the addr trigger."
+#define attack_addr_len_desc \
+    "The length of the flash address range watched by the addr trigger."
+#define attack_addr_waits_desc \
+    "The amount of chip-select low-pulses to wait for after the\r\n" \
+    "matching flash read, before the glitch will be triggered."
+#define attack_addr_timeout_desc \
+    "How many polling iterations (roughly busy loop cycles) to wait\r\n" \
+    "for the matching flash read."
+
+#define attack_calib_boots_desc \
+    "How many boots are counted by \"attack calibrate\"."
+#define attack_calib_holdoff_desc \
+    "How many ms \"attack calibrate\" waits after a counted boot\r\n" \
+    "before resetting the target again."
+#define attack_sweep_start_desc \
+    "The first delay sampled by \"attack sweep\"."
+#define attack_sweep_bin_desc \
+    "The distance of the delays sampled by \"attack sweep\"."
+#define attack_sweep_bins_desc \
+    "How many delays are sampled by \"attack sweep\"."
+
+// the per-target state (see hw_target_vars_append)
+extern hw_target_var attack_target_vars;
 
 extern cli_module attack_module;
 
@@ -65,6 +65,8 @@ bool cli_exec_cmd(char * line, unsigned n, cli_command *commands) {
     unsigned cmd_n = get_word(cmd, line, n);
 
     cli_command * command = cli_find_command(cmd, cmd_n, commands);
+    if (command && command->exec_args)
+        return command->exec_args(command->pThis, line, n);
     if (command)
         return command->exec(command->pThis);
 
@@ -516,6 +518,15 @@ void cli_list_params(bool first, cli_param *params) {
 
 
 
+bool cli_param_no_save(void * pThis) {
+    return false;
+}
+
+
+
+
+
+
 bool cli_param_u32_set(void * pThis, const char * value, unsigned value_n) {
     cli_param_u32 This = *(cli_param_u32*) pThis;
     unsigned value_parsed;
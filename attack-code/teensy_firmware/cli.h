@@ -32,9 +32,16 @@ typedef struct s_cli_param {
     cli_param_print     print;
 
     struct s_cli_param  *next;
+
+    // prints the value as set accepts it (for "config export"), 0 if
+    // print already does, cli_param_no_save if it isn't configuration
+    cli_param_print     save;
 } cli_param;
 
+bool cli_param_no_save(void * pThis);
+
 typedef bool (*cli_command_exec) (void * pThis);
+typedef bool (*cli_command_exec_args) (void * pThis, char * args, unsigned n);
 
 typedef struct s_cli_command {
     const char          *name;
@@ -44,6 +51,9 @@ typedef struct s_cli_command {
     cli_command_exec    exec;
 
     struct s_cli_command *next;
+
+    // used instead of exec if set, gets the rest of the line
+    cli_command_exec_args exec_args;
 } cli_command;
 
 typedef struct s_cli_module {
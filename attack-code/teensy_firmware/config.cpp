@@ -0,0 +1,252 @@
+// Copyright (C) 2021 Niklas Jacob
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "io.h"
+
+#include "config.h"
+
+// the modules of the cli (main.cpp)
+extern cli_module *modules;
+
+// the current configuration (export) or the one before an import
+char config_record[ConfigRecordSize];
+// the current value of a single parameter
+char config_value[ConfigValueSize];
+
+// CRC-32 (reflected, polynomial 0x04c11db7), the same as zlib.crc32
+uint32_t config_crc(const char *s, unsigned n) {
+    uint32_t crc = 0xffffffff;
+    for (unsigned i = 0; i < n; i++) {
+        crc ^= (uint8_t) s[i];
+        for (unsigned b = 0; b < 8; b++)
+            crc = crc & 1 ? (crc >> 1) ^ 0xedb88320 : crc >> 1;
+    }
+    return ~crc;
+}
+
+bool config_is_saved(cli_param *par) {
+    return par->save != cli_param_no_save;
+}
+
+bool config_save_param(cli_param *par) {
+    return par->save ? par->save(par->pThis) : par->print(par->pThis);
+}
+
+// Writes the record (without the checksum) to config_record, returns
+// its length or 0 if a parameter couldn't be saved or it didn't fit.
+unsigned config_write() {
+    bool first = true;
+    io_capture(config_record, ConfigRecordSize);
+    for (cli_module *mod = modules; mod; mod = mod->next) {
+        for (cli_param *par = mod->param; par; par = par->next) {
+            if (!config_is_saved(par))
+                continue;
+            if (!first)
+                print_char(';');
+            first = false;
+            print_str(mod->name);
+            print_char('.');
+            print_str(par->name);
+            print_char('=');
+            if (!config_save_param(par)) {
+                io_capture_end();
+                return 0;
+            }
+        }
+    }
+    unsigned n = io_capture_end();
+    return n <= ConfigRecordSize ? n : 0;
+}
+
+typedef struct {
+    cli_module  *mod;
+    cli_param   *par;
+    const char  *value;
+    unsigned    value_n;
+} config_entry;
+
+cli_module * config_find_module(const char *s, unsigned n) {
+    for (cli_module *mod = modules; mod; mod = mod->next)
+        if (str_cmp(s, n, mod->name, str_len(mod->name) + 1) == 0)
+            return mod;
+    return 0;
+}
+
+cli_param * config_find_param(cli_module *mod, const char *s, unsigned n) {
+    for (cli_param *par = mod->param; par; par = par->next)
+        if (str_cmp(s, n, par->name, str_len(par->name) + 1) == 0)
+            return par;
+    return 0;
+}
+
+// Splits the next "<module>.<param>=<value>" off the record and looks up
+// the parameter. Returns false (and prints the reason) if the entry is
+// broken or the parameter isn't part of the configuration.
+bool config_next_entry(const char *&s, unsigned &n, config_entry &e) {
+
+    unsigned len = 0, dot = 0, eq = 0;
+    for (; len < n && s[len] != ';'; len++) {
+        if (s[len] == '.' && !dot) dot = len;
+        if (s[len] == '=' && !eq) eq = len;
+    }
+
+    const char *entry = s;
+    s += len;
+    n -= len;
+    if (n) {
+        // skip the ';'
+        s++;
+        n--;
+    }
+
+    if (!dot || eq < dot + 2) {
+        print_str("Error: Malformed entry \"");
+        print_str(entry, len);
+        println("\"!");
+        return false;
+    }
+
+    e.mod = config_find_module(entry, dot);
+    e.par = e.mod ? config_find_param(e.mod, entry + dot + 1, eq - dot - 1) : 0;
+    e.value = entry + eq + 1;
+    e.value_n = len - eq - 1;
+
+    if (!e.par || !config_is_saved(e.par)) {
+        print_str("Error: \"");
+        print_str(entry, eq);
+        println("\" isn't a parameter of the configuration!");
+        return false;
+    }
+
+    return true;
+}
+
+// Sets the parameters of the record whose values differ, counts them.
+bool config_apply(const char *s, unsigned n, unsigned &changed) {
+    config_entry e;
+    changed = 0;
+    while (n) {
+        if (!config_next_entry(s, n, e))
+            return false;
+
+        io_capture(config_value, ConfigValueSize);
+        bool saved = config_save_param(e.par);
+        unsigned value_n = io_capture_end();
+        if (saved && value_n <= ConfigValueSize
+            && str_cmp(config_value, value_n, e.value, e.value_n) == 0)
+            continue;
+
+        if (!e.par->set(e.par->pThis, e.value, e.value_n)) {
+            print_str("Error: Couldn't import ");
+            print_str(e.mod->name);
+            print_char(' ');
+            print_str(e.par->name);
+            println("!");
+            return false;
+        }
+        changed++;
+    }
+    return true;
+}
+
+bool config_export(void *) {
+    unsigned n = config_write();
+    if (!n) {
+        println("Error: Couldn't export the configuration!");
+        return false;
+    }
+    print_str(config_record, n);
+    print_char('#');
+    print_hex_int(config_crc(config_record, n));
+    println();
+    return true;
+}
+
+bool config_import(void *, char *s, unsigned n) {
+
+    strip_start(s, n);
+    strip_end(s, n);
+
+    unsigned len = n;
+    while (len && s[len - 1] != '#')
+        len--;
+    if (!len) {
+        println("Error: The record has no checksum!");
+        return false;
+    }
+    len--;
+
+    const char *crc_s = s + len + 1;
+    unsigned crc_n = n - len - 1;
+    unsigned crc;
+    if (!stou(crc, crc_s, crc_n) || crc_n || crc != config_crc(s, len)) {
+        println("Error: The checksum of the record doesn't match!");
+        return false;
+    }
+
+    // check the whole record before anything is set
+    const char *check_s = s;
+    unsigned check_n = len;
+    config_entry e;
+    while (check_n)
+        if (!config_next_entry(check_s, check_n, e))
+            return false;
+
+    unsigned backup_n = config_write();
+    if (!backup_n) {
+        println("Error: Couldn't save the current configuration!");
+        return false;
+    }
+
+    unsigned changed;
+    if (!config_apply(s, len, changed)) {
+        unsigned restored;
+        if (config_apply(config_record, backup_n, restored))
+            println("The previous configuration was restored!");
+        else
+            println("Error: Couldn't restore the previous configuration!");
+        return false;
+    }
+
+    print_hex_param("changed", changed, int);
+    println("Configuration imported!");
+    return true;
+}
+
+cli_command config_import_cmd = {
+    .name           = "import",
+    .description    = config_import_cmd_desc,
+    .pThis          = 0,
+    .exec           = 0,
+    .next           = 0,
+    .exec_args      = &config_import,
+};
+
+cli_command config_export_cmd = {
+    .name           = "export",
+    .description    = config_export_cmd_desc,
+    .pThis          = 0,
+    .exec           = &config_export,
+    .next           = &config_import_cmd,
+};
+
+cli_module config_module = {
+    .name           = "config",
+    .description    = config_mod_desc,
+    .param          = 0,
+    .cmd            = &config_export_cmd,
+    .next           = 0,
+};
@@ -0,0 +1,56 @@
+// Copyright (C) 2021 Niklas Jacob
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdint.h>
+
+#include "cli.h"
+
+
+/*
+
+The configuration record holds the values of all parameters in one line:
+
+    <module>.<param>=<value>;<module>.<param>=<value>;...#<crc>
+
+The values are printed as "set" accepts them (see cli_param.save), <crc>
+is the CRC-32 (as zlib.crc32) of everything before the '#'.
+
+*/
+
+// the record has to fit the prompt line (LINE_SIZE)
+constexpr unsigned ConfigRecordSize = 3072;
+constexpr unsigned ConfigValueSize  = 256;
+
+
+#define config_mod_desc \
+    "Exports and imports the values of all parameters as one record:\r\n" \
+    "  <module>.<param>=<value>;...#<crc32>\r\n" \
+    "(hw target and prompt machine aren't part of it)"
+#define config_export_cmd_desc \
+    "Prints the record of the current configuration."
+#define config_import_cmd_desc \
+    "Applies a record (config import <record>). The whole record is\r\n" \
+    "checked first (checksum, modules and parameters), then only the\r\n" \
+    "parameters with other values are set. If a value is rejected, the\r\n" \
+    "previous configuration is restored."
+
+extern cli_module config_module;
+
+
+#endif /* CONFIG_H */
@@ -17,15 +17,27 @@
 #include "amd_cmds.h"
 
 #include "glitch.h"
+#include "rail.h"
+#include "restart.h"
+#include "stats.h"
+#include "trace.h"
+#include "timing.h"
+#include "sniff.h"
 
 bool        glitch_cs_was_low_at_glitch = false;
 
 bool        glitch_armed            = false;
 
+hw_target_var glitch_target_vars    = make_hw_target_var(glitch_armed, 0);
+
 Command     glitch_cmd              = DefaultGlitchCmd;
 
 uint32_t    glitch_delay            = DefaultGlitchDelay;
 uint32_t    glitch_duration         = DefaultGlitchDuration;
+uint8_t     glitch_stop             = DefaultGlitchStop;
+uint8_t     glitch_restore_mode     = DefaultGlitchRestore;
+uint32_t    glitch_depth            = DefaultGlitchDepth;
+uint32_t    glitch_max_dwell        = DefaultGlitchMaxDwell;
 uint32_t    glitch_cooldown         = DefaultGlitchCooldown;
 uint32_t    glitch_repeats          = DefaultGlitchRepeats;
 
@@ -33,22 +45,81 @@ uint32_t    glitch_cs_timeout       = DefaultGlitchCSTimeout;
 uint32_t    glitch_ping_wait        = DefaultGlitchPingWait;
 uint32_t    glitch_success_wait     = DefaultGlitchSuccessWait;
 
+bool        glitch_verify           = DefaultGlitchVerify;
+bool        glitch_verify_error     = DefaultGlitchVerifyError;
+
+// mismatches of the read back packets in the last attempt
+uint32_t    glitch_mismatches       = 0;
+
+// loopback counters (since the last loopback_clear)
+struct {
+    uint32_t attempts, packets, mismatches, mismatched_attempts, flagged;
+} glitch_loopback;
+
+// how the default vids were set again in the last attempt and how many
+// cpu cycles it took (from the end of the dwell)
+uint8_t     glitch_restore_used     = glitch_restore_separate;
+uint32_t    glitch_restore_cycles   = 0;
+
+// busy loop cycles the configured vid was active in the rail stop mode
+uint32_t    glitch_dwell            = 0;
+bool        glitch_dwell_timeout    = false;
+
 cmd_param glitch_cmd_this = { .pCmd = &glitch_cmd, .pDefault = &DefaultGlitchCmd };
 
 cli_param_u32 glitch_delay_this         = make_cli_param_u32(glitch_delay,          DefaultGlitchDelay,         0, 0xffffffff);
 cli_param_u32 glitch_duration_this      = make_cli_param_u32(glitch_duration,       DefaultGlitchDuration,      0, 0xffffffff);
+cli_param_u32 glitch_depth_this         = make_cli_param_u32(glitch_depth,          DefaultGlitchDepth,         0, 0xffff);
+cli_param_u32 glitch_max_dwell_this     = make_cli_param_u32(glitch_max_dwell,      DefaultGlitchMaxDwell,      0, 0xffffffff);
 cli_param_u32 glitch_cooldown_this      = make_cli_param_u32(glitch_cooldown,       DefaultGlitchCooldown,      0, 0xffffffff);
 cli_param_u32 glitch_repeats_this       = make_cli_param_u32(glitch_repeats,        DefaultGlitchRepeats,       0, 0xffffffff);
 cli_param_u32 glitch_cs_timeout_this    = make_cli_param_u32(glitch_cs_timeout,     DefaultGlitchCSTimeout,     0, 0xffffffff);
 cli_param_u32 glitch_ping_wait_this     = make_cli_param_u32(glitch_ping_wait,      DefaultGlitchPingWait,      0, 0xffffffff);
 cli_param_u32 glitch_success_wait_this  = make_cli_param_u32(glitch_success_wait,   DefaultGlitchSuccessWait,   0, 0xffffffff);
 
-cli_param glitch_success_wait_param = make_cli_param_u32_param("success_wait",  glitch_success_wait_desc,   glitch_success_wait_this,   0);
+cli_param_bool glitch_verify_this       = make_cli_param_bool(glitch_verify,       DefaultGlitchVerify);
+cli_param_bool glitch_verify_error_this = make_cli_param_bool(glitch_verify_error, DefaultGlitchVerifyError);
+
+cli_param glitch_verify_error_param = make_cli_param_bool_param("verify_error", glitch_verify_error_desc,   glitch_verify_error_this,   0);
+cli_param glitch_verify_param       = make_cli_param_bool_param("verify",       glitch_verify_desc,         glitch_verify_this,         &glitch_verify_error_param);
+cli_param glitch_success_wait_param = make_cli_param_u32_param("success_wait",  glitch_success_wait_desc,   glitch_success_wait_this,   &glitch_verify_param);
 cli_param glitch_ping_wait_param    = make_cli_param_u32_param("ping_wait",     glitch_ping_wait_desc,      glitch_ping_wait_this,      &glitch_success_wait_param);
 cli_param glitch_cs_timeout_param   = make_cli_param_u32_param("cs_timeout",    glitch_cs_timeout_desc,     glitch_cs_timeout_this,     &glitch_ping_wait_param);
 cli_param glitch_repeats_param      = make_cli_param_u32_param("repeats",       glitch_repeats_desc,        glitch_repeats_this,        &glitch_cs_timeout_param);
 cli_param glitch_cooldown_param     = make_cli_param_u32_param("cooldown",      glitch_cooldown_desc,       glitch_cooldown_this,       &glitch_repeats_param);
-cli_param glitch_duration_param     = make_cli_param_u32_param("duration",      glitch_duration_desc,       glitch_duration_this,       &glitch_cooldown_param);
+cli_param glitch_max_dwell_param   = make_cli_param_u32_param("max_dwell",     glitch_max_dwell_desc,      glitch_max_dwell_this,      &glitch_cooldown_param);
+cli_param glitch_depth_param       = make_cli_param_u32_param("depth",         glitch_depth_desc,          glitch_depth_this,          &glitch_max_dwell_param);
+
+bool glitch_stop_set(void * pThis, const char *value, unsigned n);
+bool glitch_stop_reset(void * pThis);
+bool glitch_stop_print(void *pThis);
+
+cli_param glitch_stop_param = {
+    .name           = "stop",
+    .description    = glitch_stop_desc,
+    .pThis          = 0,
+    .set            = glitch_stop_set,
+    .reset          = glitch_stop_reset,
+    .print          = glitch_stop_print,
+    .next           = &glitch_depth_param,
+};
+
+bool glitch_restore_set(void * pThis, const char *value, unsigned n);
+bool glitch_restore_reset(void * pThis);
+bool glitch_restore_print(void *pThis);
+bool glitch_restore_print_mode(uint8_t mode);
+
+cli_param glitch_restore_param = {
+    .name           = "restore",
+    .description    = glitch_restore_desc,
+    .pThis          = 0,
+    .set            = glitch_restore_set,
+    .reset          = glitch_restore_reset,
+    .print          = glitch_restore_print,
+    .next           = &glitch_stop_param,
+};
+
+cli_param glitch_duration_param     = make_cli_param_u32_param("duration",      glitch_duration_desc,       glitch_duration_this,       &glitch_restore_param);
 cli_param glitch_delay_param        = make_cli_param_u32_param("delay",         glitch_delay_desc,          glitch_delay_this,          &glitch_duration_param);
 
 cli_param glitch_core_param         = make_cmd_core_param(                                                  glitch_cmd_this,            &glitch_delay_param);
@@ -56,32 +127,100 @@ cli_param glitch_soc_param          = make_cmd_soc_param(
 cli_param glitch_vid_param          = make_cmd_vid_param(                                                   glitch_cmd_this,            &glitch_soc_param);
 
 bool glitch_print_result(glitch_result result) {
-    if (glitch_delay < glitch_duration)
+    if (glitch_stop == glitch_stop_time && glitch_delay < glitch_duration)
         println("Warning: duration is larger than delay!");
 
+    bool ok = true;
+    bool broken = result == glitch_target_broken;
+    bool flagged = false;
+
+    if (glitch_verify) {
+        glitch_loopback.attempts++;
+        if (glitch_mismatches) {
+            glitch_loopback.mismatched_attempts++;
+            if (glitch_verify_error && result != glitch_error) {
+                glitch_loopback.flagged++;
+                flagged = true;
+                result = glitch_error;
+            }
+        }
+    }
+
+    trace_event(trace_result, result);
     switch (result) {
 
         case glitch_target_running:
             println("Target continues running!");
-            return true;
+            break;
 
         case glitch_target_broken:
             println("Target is broken!");
-            return true;
+            break;
 
         case glitch_success:
             println("Target glitched successfully!");
-            return true;
+            break;
 
         case glitch_error:
             println("Error: The injection of one of the commands/packets failed!");
-            return false;
+            ok = false;
+            break;
 
         default:
             println("Error: Unknown result (this should never happen)!");
-            return false;
+            ok = false;
+            break;
+
+    }
 
+    // (after the result line, the host matches the message from its start)
+    if (glitch_stop == glitch_stop_rail) {
+        if (!rail_is_enabled())
+            println("Warning: The rail isn't sampled, stopped after max_dwell!");
+        else if (glitch_dwell_timeout)
+            println("Warning: The rail didn't reach depth, stopped after max_dwell!");
+        print_str("Dwell: ");
+        print_hex_int(glitch_dwell);
+        println(" busy loop cycles");
     }
+
+    if (glitch_cmd.soc && glitch_cmd.core && glitch_repeats) {
+        print_str("Restore: ");
+        print_hex_int(glitch_restore_cycles);
+        print_str(" cycles (");
+        glitch_restore_print_mode(glitch_restore_used);
+        println(")");
+    }
+
+    if (glitch_verify && glitch_mismatches) {
+        print_str("Warning: ");
+        print_hex_int(glitch_mismatches);
+        println(" injected packets weren't read back unchanged!");
+    }
+
+    rail_print_capture();
+    stats_print_last();
+
+    // (a broken target is recovered even if the attempt was flagged)
+    if (ok || flagged)
+        restart_glitch_result(broken);
+
+    return ok;
+}
+
+bool glitch_loopback_show(void * pThis) {
+    print_hex_param("attempts", glitch_loopback.attempts, int);
+    print_hex_param("packets", glitch_loopback.packets, int);
+    print_hex_param("mismatched packets", glitch_loopback.mismatches, int);
+    print_hex_param("mismatched attempts", glitch_loopback.mismatched_attempts, int);
+    print_hex_param("flagged attempts", glitch_loopback.flagged, int);
+    return true;
+}
+
+bool glitch_loopback_clear(void * pThis) {
+    glitch_loopback = {};
+    println("Loopback counters cleared!");
+    return true;
 }
 
 bool glitch_arm(void * pThis) {
@@ -100,12 +239,28 @@ bool do_glitch(void * pThis) {
     return glitch_print_result(result);
 }
 
+cli_command glitch_loopback_clear_cmd = {
+    .name           = "loopback_clear",
+    .description    = glitch_loopback_clear_cmd_desc,
+    .pThis          = 0,
+    .exec           = &glitch_loopback_clear,
+    .next           = 0,
+};
+
+cli_command glitch_loopback_cmd = {
+    .name           = "loopback",
+    .description    = glitch_loopback_cmd_desc,
+    .pThis          = 0,
+    .exec           = &glitch_loopback_show,
+    .next           = &glitch_loopback_clear_cmd,
+};
+
 cli_command glitch_arm_cmd = {
     .name           = "arm",
     .description    = glitch_arm_cmd_desc,
     .pThis          = 0,
     .exec           = &glitch_arm,
-    .next           = 0,
+    .next           = &glitch_loopback_cmd,
 };
 
 cli_command glitch_man_cmd = {
@@ -127,21 +282,33 @@ cli_module glitch_module = {
 
 
 
-void glitch_process_trigger() {
+// the glitch for the pins of a configuration (see HW_PINS_CALL)
+template <class PINS>
+glitch_result glitch_on();
+
+template <class PINS>
+FASTRUN void glitch_process_trigger_on() {
+
+    typename PINS::cs_pin cs_pin;
 
     if (!glitch_armed) return;
     // Glitch armed
 
-    if (hw.cs_pin.is_high() || hw.cs_pin.is_high()) return;
+    if (cs_pin.is_high() || cs_pin.is_high()) return;
     // Glitch triggered
 
+    hw_critical_begin();
+
     uint32_t timeout = glitch_cs_timeout;
-    BUSY_LOOP_WHILE_PIN_LOW(cs_low_trigger, timeout, hw.cs_pin);
-    if (timeout == 0) return; // CS was low for too long
+    BUSY_LOOP_WHILE_PIN_LOW(cs_low_trigger, timeout, cs_pin);
+    if (timeout == 0) {
+        hw_critical_end();
+        return; // CS was low for too long
+    }
     // Glitch triggered
 
     glitch_armed = false;
-    glitch_result result = glitch();
+    glitch_result result = glitch_on<PINS>();
 
     // Do serial io only after time-critical code
     prompt_use_new_line();
@@ -149,94 +316,299 @@ void glitch_process_trigger() {
 
     glitch_print_result(result);
 
+    hw_critical_end();
+
 }
 
-glitch_result glitch() {
+void glitch_process_trigger() {
+    HW_PINS_CALL(glitch_process_trigger_on);
+}
+
+// Sends the command, with verify it is read back and mismatches counted.
+FASTRUN int glitch_send(Command cmd) {
+    if (!glitch_verify)
+        return cmd.send(twi_master, twi_timeout);
+
+    bool verified;
+    int rc = sniff_send_verified(cmd.to_raw(), verified);
+    glitch_loopback.packets++;
+    if (rc >= 0 && !verified) {
+        glitch_mismatches++;
+        glitch_loopback.mismatches++;
+    }
+    return rc;
+}
+
+// Sets the default vids of the glitched rails again.
+// Returns negative error codes on error (like Twi::Master::send_u16).
+FASTRUN int glitch_restore() {
+
+    glitch_restore_used = glitch_restore_separate;
+
+    if (glitch_cmd.soc && glitch_cmd.core && glitch_restore_mode == glitch_restore_burst) {
+
+        // one packet sets both rails if the rest of the commands is equal
+        // (the rail bits are part of the address byte)
+        if (soc_cmd.to_raw().data == core_cmd.to_raw().data) {
+            glitch_restore_used = glitch_restore_combined;
+            return glitch_send(soc_cmd.Core());
+        }
+
+        // (the sniffer can't read back while the burst is fed)
+        if (!glitch_verify) {
+            glitch_restore_used = glitch_restore_burst;
+            int rc = CommandRaw::send_pair(twi_master, soc_cmd.to_raw(), core_cmd.to_raw(), twi_timeout);
+            if (rc < 0) {
+                // Error recovery
+                soc_cmd.send(twi_master, twi_timeout);
+                core_cmd.send(twi_master, twi_timeout);
+            }
+            return rc;
+        }
+    }
+
+    if (glitch_cmd.soc) {
+        int rc = glitch_send(soc_cmd);
+        if (rc < 0) {
+            // Error recovery
+            if (glitch_cmd.core)
+                core_cmd.send(twi_master, twi_timeout);
+            return rc;
+        }
+    }
+    if (glitch_cmd.core)
+        return glitch_send(core_cmd);
+    return 0;
+}
+
+template <class PINS>
+FASTRUN glitch_result glitch_on() {
     // Glitch triggered
 
-    hw_trigger_glitch_set_high();
-    uint32_t timeout = glitch_delay - glitch_duration;
+    typename PINS::cs_pin cs_pin;
+
+    glitch_mismatches = 0;
+
+    bool stop_by_rail = glitch_stop == glitch_stop_rail && rail_is_enabled();
+
+    hw_trigger_set_high<PINS>(hw_trigger_glitch, trace_glitch);
+    uint32_t timeout = glitch_delay;
+    if (glitch_stop == glitch_stop_time)
+        timeout -= glitch_duration;
+    const uint32_t delay_loops = timeout;
+    const uint32_t delay_start = ARM_DWT_CYCCNT;
     if (timeout <= glitch_delay)
         BUSY_LOOP(glitch_delay, timeout);
-    hw_trigger_glitch_set_low();
+    const uint32_t delay_end = ARM_DWT_CYCCNT;
+    const uint32_t delay_cycles = delay_end - delay_start;
+    hw_trigger_set_low<PINS>(hw_trigger_glitch, trace_glitch);
+
+    rail_glitch_start();
+
+    // the rail is compared in cpu cycles (busy loop cycles take ~10)
+    uint16_t depth = rail_sample_of_mv(glitch_depth);
+    uint32_t max_dwell = (uint64_t) glitch_max_dwell * F_CPU_ACTUAL / rough_busy_wait_ms(1000);
+
+    // time stamps of the last repetition (for the stats module), the
+    // latency is the one of the first
+    uint32_t send_start = 0, send_end = 0, dwell_end = 0, restore_end = 0;
+    uint32_t first_send_end = 0;
 
     for (uint32_t i = 0; i < glitch_repeats; i++) {
 
         // Glitch start
-        hw_trigger_glitch_set_high();
-        if (glitch_cmd.send(twi_master, twi_timeout) < 0) {
+        hw_trigger_set_high<PINS>(hw_trigger_glitch, trace_glitch);
+        send_start = ARM_DWT_CYCCNT;
+        int rc = glitch_send(glitch_cmd);
+        send_end = ARM_DWT_CYCCNT;
+        if (i == 0)
+            first_send_end = send_end;
+        if (rc < 0) {
             // Error recovery
             if (glitch_cmd.core)
                 core_cmd.send(twi_master, twi_timeout);
             if (glitch_cmd.soc)
                 soc_cmd.send(twi_master, twi_timeout);
-            hw_trigger_glitch_set_low();
+            hw_trigger_set_low<PINS>(hw_trigger_glitch, trace_glitch);
+            rail_glitch_end();
             return glitch_error;
         }
 
-        timeout = glitch_duration;
-        BUSY_LOOP(glitch_duration, timeout);
+        if (stop_by_rail) {
+            uint32_t start = ARM_DWT_CYCCNT, cycles = 0;
+            while (rail_latest_sample() > depth && cycles < max_dwell)
+                cycles = ARM_DWT_CYCCNT - start;
+            glitch_dwell_timeout = cycles >= max_dwell;
+            glitch_dwell = (uint64_t) cycles * rough_busy_wait_ms(1000) / F_CPU_ACTUAL;
+        } else if (glitch_stop == glitch_stop_rail) {
+            timeout = glitch_max_dwell;
+            BUSY_LOOP(glitch_max_dwell, timeout);
+            glitch_dwell_timeout = true;
+            glitch_dwell = glitch_max_dwell;
+        } else {
+            timeout = glitch_duration;
+            BUSY_LOOP(glitch_duration, timeout);
+        }
 
         // Glitch end
-        if (glitch_cmd.soc)
-            if (soc_cmd.send(twi_master, twi_timeout) < 0) {
-                if (glitch_cmd.core)
-                    core_cmd.send(twi_master, twi_timeout);
-                hw_trigger_glitch_set_low();
-                return glitch_error;
-            }
-        if (glitch_cmd.core)
-            if (core_cmd.send(twi_master, twi_timeout) < 0) {
-                hw_trigger_glitch_set_low();
-                return glitch_error;
-            }
-        glitch_cs_was_low_at_glitch = hw.cs_pin.is_low();
-        hw_trigger_glitch_set_low();
+        dwell_end = ARM_DWT_CYCCNT;
+        if (glitch_restore() < 0) {
+            hw_trigger_set_low<PINS>(hw_trigger_glitch, trace_glitch);
+            rail_glitch_end();
+            return glitch_error;
+        }
+        restore_end = ARM_DWT_CYCCNT;
+        glitch_cs_was_low_at_glitch = cs_pin.is_low();
+        hw_trigger_set_low<PINS>(hw_trigger_glitch, trace_glitch);
 
         timeout = glitch_cooldown;
         BUSY_LOOP(glitch_cooldown, timeout);
     }
 
+    rail_glitch_end();
+    if (delay_loops <= glitch_delay)
+        hw_jitter_record(delay_loops, delay_cycles);
+
+    stats_record(stats_delay, delay_cycles);
+    if (glitch_repeats) {
+        stats_record(stats_latency, first_send_end - delay_end);
+        stats_record(stats_send, send_end - send_start);
+        stats_record(stats_dwell, dwell_end - send_end);
+        stats_record(stats_restore, restore_end - dwell_end);
+        glitch_restore_cycles = restore_end - dwell_end;
+    }
+
+    // the outcome waits take up to ping_wait, they need no protection from
+    // jitter (and millis() has to keep counting for the restart timers)
+    hw_critical_end();
+
     // Glitch done
-    timeout = glitch_ping_wait;
-    BUSY_LOOP_WHILE_PIN_HIGH(wait_ping, timeout, hw.cs_pin);
+    uint32_t ping_wait = timing_timeout(timing_ping, glitch_ping_wait);
+    uint32_t cs_timeout = timing_timeout(timing_cs_low, glitch_cs_timeout);
+    timeout = ping_wait;
+    const uint32_t ping_start = ARM_DWT_CYCCNT;
+    BUSY_LOOP_WHILE_PIN_HIGH(wait_ping, timeout, cs_pin);
+    const uint32_t ping_end = ARM_DWT_CYCCNT;
     if (timeout == 0) {
-        hw_trigger_glitch_broken_set_high();
+        hw_trigger_set_high<PINS>(hw_trigger_glitch_broken, trace_broken);
         timeout = 10;
         BUSY_LOOP(glitch_broken_trigger, timeout);
-        hw_trigger_glitch_broken_set_low();
+        hw_trigger_set_low<PINS>(hw_trigger_glitch_broken, trace_broken);
         return glitch_target_broken; // No ping detected
     }
 
     // Ping detected
-    timeout = glitch_cs_timeout;
-    BUSY_LOOP_WHILE_PIN_LOW(cs_low_ping, timeout, hw.cs_pin);
+    trace_event(trace_cs, 0);
+    timing_record(timing_ping, ping_wait - timeout);
+    stats_record(stats_ping, ping_end - ping_start);
+    timeout = cs_timeout;
+    BUSY_LOOP_WHILE_PIN_LOW(cs_low_ping, timeout, cs_pin);
     if (timeout == 0) {
-        hw_trigger_glitch_broken_set_high();
+        hw_trigger_set_high<PINS>(hw_trigger_glitch_broken, trace_broken);
         timeout = 10;
         BUSY_LOOP(glitch_broken_trigger, timeout);
-        hw_trigger_glitch_broken_set_low();
+        hw_trigger_set_low<PINS>(hw_trigger_glitch_broken, trace_broken);
         return glitch_target_broken; // Might not have been a ping
     }
 
     // Target running
+    trace_event(trace_cs, 1);
     timeout = glitch_success_wait;
-    BUSY_LOOP_WHILE_PIN_HIGH(success_wait, timeout, hw.cs_pin);
+    BUSY_LOOP_WHILE_PIN_HIGH(success_wait, timeout, cs_pin);
 
     if (timeout == 0) {
         // No success ping
-        hw_trigger_glitch_running_set_high();
+        hw_trigger_set_high<PINS>(hw_trigger_glitch_running, trace_running);
         timeout = 10;
         BUSY_LOOP(glitch_running_trigger, timeout);
-        hw_trigger_glitch_running_set_low();
+        hw_trigger_set_low<PINS>(hw_trigger_glitch_running, trace_running);
         return glitch_target_running;
     }
 
     // Success ping detected
-    hw_trigger_glitch_success_set_high();
+    trace_event(trace_cs, 0);
+    hw_trigger_set_high<PINS>(hw_trigger_glitch_success, trace_success);
     timeout = 10;
     BUSY_LOOP(glitch_success_trigger, timeout);
-    hw_trigger_glitch_success_set_low();
+    hw_trigger_set_low<PINS>(hw_trigger_glitch_success, trace_success);
     return glitch_success;
 }
 
+glitch_result glitch() {
+    return HW_PINS_CALL(glitch_on);
+}
+
+bool glitch_stop_set(void * pThis, const char *value, unsigned n) {
+    if (str_cmp(value, n, "time", sizeof("time")) == 0) {
+        glitch_stop = glitch_stop_time;
+        return true;
+    }
+    if (str_cmp(value, n, "rail", sizeof("rail")) == 0) {
+        if (!rail_is_enabled())
+            println("Warning: The rail isn't sampled (see \"help rail enabled\")!");
+        glitch_stop = glitch_stop_rail;
+        return true;
+    }
+    println("Error: Couldn't parse value, use time or rail!");
+    return false;
+}
+
+bool glitch_restore_set(void * pThis, const char *value, unsigned n) {
+    if (str_cmp(value, n, "separate", sizeof("separate")) == 0) {
+        glitch_restore_mode = glitch_restore_separate;
+        return true;
+    }
+    if (str_cmp(value, n, "burst", sizeof("burst")) == 0) {
+        glitch_restore_mode = glitch_restore_burst;
+        return true;
+    }
+    println("Error: Couldn't parse value, use separate or burst!");
+    return false;
+}
+
+bool glitch_restore_reset(void * pThis) {
+    glitch_restore_mode = DefaultGlitchRestore;
+    return true;
+}
+
+bool glitch_restore_print_mode(uint8_t mode) {
+    switch (mode) {
+        case glitch_restore_separate:
+            print_str("separate");
+            break;
+        case glitch_restore_burst:
+            print_str("burst");
+            break;
+        case glitch_restore_combined:
+            print_str("combined");
+            break;
+        default:
+            print_str("unknown (this should never happen)");
+            return false;
+    }
+    return true;
+}
+
+bool glitch_restore_print(void * pThis) {
+    return glitch_restore_print_mode(glitch_restore_mode);
+}
+
+bool glitch_stop_reset(void * pThis) {
+    glitch_stop = DefaultGlitchStop;
+    return true;
+}
+
+bool glitch_stop_print(void * pThis) {
+    switch (glitch_stop) {
+        case glitch_stop_time:
+            print_str("time");
+            break;
+        case glitch_stop_rail:
+            print_str("rail");
+            break;
+        default:
+            print_str("unknown (this should never happen)");
+            return false;
+    }
+    return true;
+}
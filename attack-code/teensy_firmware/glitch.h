@@ -52,6 +52,23 @@ constexpr Command   DefaultGlitchCmd            = DefaultSocCmd.Vid(DefaultGlitc
 constexpr uint32_t  DefaultGlitchDelay          = rough_busy_wait_us(   200);
 constexpr uint32_t  DefaultGlitchDuration       = rough_busy_wait_us_f(  20.5);
 
+enum glitch_stop_mode : uint8_t {
+    glitch_stop_time,
+    glitch_stop_rail,
+};
+
+constexpr uint8_t   DefaultGlitchStop           = glitch_stop_time;
+
+enum glitch_restore_mode : uint8_t {
+    glitch_restore_separate,
+    glitch_restore_burst,
+    // (only reported, used by burst if the default commands allow it)
+    glitch_restore_combined,
+};
+constexpr uint8_t   DefaultGlitchRestore        = glitch_restore_burst;
+constexpr uint32_t  DefaultGlitchDepth          = 700; // mV
+constexpr uint32_t  DefaultGlitchMaxDwell       = rough_busy_wait_us(    50);
+
 constexpr uint32_t  DefaultGlitchCooldown       = rough_busy_wait_us(    80);
 constexpr uint32_t  DefaultGlitchRepeats        = 1;
 
@@ -59,6 +76,9 @@ constexpr uint32_t  DefaultGlitchCSTimeout      = rough_busy_wait_us(   100);
 constexpr uint32_t  DefaultGlitchPingWait       = rough_busy_wait_ms(   500);
 constexpr uint32_t  DefaultGlitchSuccessWait    = rough_busy_wait_us(    10);
 
+constexpr bool      DefaultGlitchVerify         = false;
+constexpr bool      DefaultGlitchVerifyError    = false;
+
 
 #define glitch_mod_desc \
     "A glitch can either be triggered by an attack, by a chip-select\r\n" \
@@ -66,7 +86,8 @@ constexpr uint32_t  DefaultGlitchSuccessWait    = rough_busy_wait_us(    10);
     "wait delay - duration many busy loop cycles. Then repeats many\r\n" \
     "times the following steps will be executed:\r\n" \
     "  - sets the configured vid (for the configured voltage)\r\n" \
-    "  - wait duration many busy loop cycles\r\n" \
+    "  - wait duration many busy loop cycles (or until the rail is\r\n" \
+    "    low enough, see stop)\r\n" \
     "  - sets the configured default vid (in cmd_soc or cmd_core)\r\n" \
     "  - wait cooldown many busy loop cycles\r\n" \
     "Then the result detection starts:\r\n" \
@@ -90,6 +111,24 @@ constexpr uint32_t  DefaultGlitchSuccessWait    = rough_busy_wait_us(    10);
     "duration of the glitch will be subtracted beforehand)."
 #define glitch_duration_desc \
     "The time for which the configured vid will be active."
+#define glitch_stop_desc \
+    "When the configured vid is replaced by the default vid again:\r\n" \
+    "  time -> after duration many busy loop cycles\r\n" \
+    "  rail -> as soon as the rail sampled by the rail module is below\r\n" \
+    "          depth, but after max_dwell many busy loop cycles at most\r\n" \
+    "          (the delay isn't shortened by the duration in this mode)"
+#define glitch_restore_desc \
+    "How the default vids are set again if both rails are glitched:\r\n" \
+    "  separate -> soc_cmd and then core_cmd as two transactions\r\n" \
+    "  burst    -> one packet for both rails if soc_cmd and core_cmd only\r\n" \
+    "              differ in the rail bits, else both packets back-to-back\r\n" \
+    "              in one burst (separate while verify is set)\r\n" \
+    "The time the restore took is reported after the result."
+#define glitch_depth_desc \
+    "The rail voltage (in mV) that ends the glitch in the rail stop mode."
+#define glitch_max_dwell_desc \
+    "The longest time (in busy loop cycles) the configured vid is\r\n" \
+    "active in the rail stop mode."
 #define glitch_cooldown_desc \
     "The time to wait before executing another glitch or starting\r\n" \
     "the chip-select detection."
@@ -101,6 +140,17 @@ constexpr uint32_t  DefaultGlitchSuccessWait    = rough_busy_wait_us(    10);
     "How long to wait for a chip-select pulse after the cooldown."
 #define glitch_success_wait_desc \
     "How long to wait for the second chip-select pulse."
+#define glitch_verify_desc \
+    "Whether the injected packets are read back on the svc/svd input\r\n" \
+    "pins and compared with what was sent (packets that were changed on\r\n" \
+    "the bus or weren't acknowledged are counted as mismatches)."
+#define glitch_verify_error_desc \
+    "Whether an attempt with mismatches is reported as an error (and\r\n" \
+    "not as the target state), so it isn't counted as a result."
+#define glitch_loopback_cmd_desc \
+    "Prints the mismatch counters of the read back packets."
+#define glitch_loopback_clear_cmd_desc \
+    "Clears the mismatch counters of the read back packets."
 
 extern bool glitch_cs_was_low_at_glitch;
 
@@ -117,6 +167,9 @@ void glitch_process_trigger();
 
 glitch_result glitch();
 
+// the per-target state (see hw_target_vars_append)
+extern hw_target_var glitch_target_vars;
+
 extern cli_module glitch_module;
 
 #endif /* GLITCH_H */
@@ -0,0 +1,75 @@
+// Copyright (C) 2021 Niklas Jacob
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+// Log-linear histogram of 32 bit values: every power of two is split
+// into HistogramSubBins bins, so a bin is at most 1/8 of its values wide.
+// Adding a value is cheap enough for the time-critical loops.
+constexpr unsigned HistogramSubBits = 3;
+constexpr unsigned HistogramSubBins = 1 << HistogramSubBits;
+constexpr unsigned HistogramBins    = (32 - HistogramSubBits + 1) * HistogramSubBins;
+
+struct histogram {
+    uint32_t counts[HistogramBins];
+    uint32_t total;
+
+    static unsigned bin_of(uint32_t v) {
+        if (v < HistogramSubBins)
+            return v;
+        unsigned e = 31 - __builtin_clz(v);
+        unsigned shift = e - HistogramSubBits;
+        return (shift + 1) * HistogramSubBins + ((v >> shift) & (HistogramSubBins - 1));
+    }
+
+    // the highest value of a bin
+    static uint32_t bin_max(unsigned bin) {
+        if (bin < HistogramSubBins)
+            return bin;
+        unsigned shift = bin / HistogramSubBins - 1;
+        uint64_t first = (uint64_t) (HistogramSubBins + bin % HistogramSubBins) << shift;
+        return first + ((uint64_t) 1 << shift) - 1;
+    }
+
+    void clear() {
+        for (unsigned i = 0; i < HistogramBins; i++)
+            counts[i] = 0;
+        total = 0;
+    }
+
+    void add(uint32_t v) {
+        counts[bin_of(v)]++;
+        total++;
+    }
+
+    // the highest value of the bin holding the permille-th value
+    // (rounded up, zero for an empty histogram)
+    uint32_t percentile(uint32_t permille) const {
+        uint64_t rank = ((uint64_t) total * permille + 999) / 1000;
+        if (rank == 0) rank = 1;
+        uint32_t n = 0;
+        for (unsigned i = 0; i < HistogramBins; i++) {
+            n += counts[i];
+            if (n >= rank)
+                return bin_max(i);
+        }
+        return 0;
+    }
+};
+
+#endif /* HISTOGRAM_H */
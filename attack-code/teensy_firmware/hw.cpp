@@ -13,13 +13,23 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
+#include <string.h>
+
 #include "hw.h"
 #include "io.h"
+#include "prompt.h"
+#include "trace.h"
+#include "sniff.h"
+#include "amd_cmds.h"
 
 Twi::Master     twi_master;
+Spi::Sniffer    spi_sniffer;
 hardware_config hw = HwCfg1();
 
-void hw_init(hardware_config cfg) {
+uint32_t        hw_baudrate     = DefaultHwBaudrate;
+bool            hw_spi_enabled  = false;
+
+void hw_init(hardware_config cfg, bool spi) {
 
     hw = cfg;
 
@@ -36,17 +46,28 @@ void hw_init(hardware_config cfg) {
 
     twi_master = Twi::Master(
         { .ignore_nacks = true },
-        cfg.twi_hardware.open_drain_output_only()
+        cfg.twi_hardware.open_drain_output_only().Baudrate(hw_baudrate)
     );
     twi_master.setup();
     twi_master.enable();
 
+    hw_spi_enabled = spi;
+    if (spi) {
+        spi_sniffer = Spi::Sniffer(cfg.spi_hardware);
+        spi_sniffer.setup();
+        spi_sniffer.enable();
+    }
+
 }
 
 void hw_deinit() {
 
     twi_master.disable();
 
+    if (hw_spi_enabled)
+        spi_sniffer.reset();
+    hw_spi_enabled = false;
+
     hw.sda_in_pin.write(Gpio::Config());
     hw.scl_in_pin.write(Gpio::Config());
 
@@ -58,6 +79,153 @@ void hw_deinit() {
     hw.reset_pin.write(Gpio::Config());
 }
 
+uint8_t hw_target      = 0;
+uint8_t hw_targets     = 1;
+uint8_t hw_cli_target  = 0;
+
+// the saved state of the targets and (last) the initial state
+uint8_t hw_target_state[HwTargets + 1][HwTargetStateSize] __attribute__((aligned(8)));
+uint32_t hw_target_state_used = 0;
+// a list didn't fit (its variables would be shared), "hw config both" is refused
+bool hw_target_state_full = false;
+
+hw_target_var hw_spi_enabled_var    = make_hw_target_var(hw_spi_enabled,    0);
+hw_target_var hw_spi_sniffer_var    = make_hw_target_var(spi_sniffer,       &hw_spi_enabled_var);
+hw_target_var hw_twi_master_var     = make_hw_target_var(twi_master,        &hw_spi_sniffer_var);
+hw_target_var hw_target_vars        = make_hw_target_var(hw,                &hw_twi_master_var);
+
+hw_target_var *hw_target_var_list   = 0;
+
+void hw_target_vars_append(hw_target_var &vars) {
+
+    uint32_t used = hw_target_state_used;
+    for (hw_target_var *var = &vars; var; var = var->next)
+        used = ((used + 7) & ~7u) + var->size;
+    if (used > HwTargetStateSize) {
+        // (at boot, before a host is attached)
+        println("Error: The per-target state doesn't fit, increase HwTargetStateSize!");
+        hw_target_state_full = true;
+        return;
+    }
+
+    for (hw_target_var *var = &vars; var; var = var->next) {
+        var->offset = (hw_target_state_used + 7) & ~7u;
+        hw_target_state_used = var->offset + var->size;
+        for (unsigned t = 0; t <= HwTargets; t++)
+            memcpy(hw_target_state[t] + var->offset, var->ptr, var->size);
+    }
+
+    if (!hw_target_var_list) {
+        hw_target_var_list = &vars;
+        return;
+    }
+    hw_target_var *last = hw_target_var_list;
+    while (last->next)
+        last = last->next;
+    last->next = &vars;
+}
+
+void hw_target_select(uint8_t target) {
+    static const char * const tags[HwTargets] = { "[1] ", "[2] " };
+
+    if (target == hw_target)
+        return;
+
+    for (hw_target_var *var = hw_target_var_list; var; var = var->next) {
+        memcpy(hw_target_state[hw_target] + var->offset, var->ptr, var->size);
+        memcpy(var->ptr, hw_target_state[target] + var->offset, var->size);
+    }
+    hw_target = target;
+
+    prompt_set_tag(hw_targets > 1 ? tags[target] : "");
+}
+
+// Starts the (not selected) target over with the initial state.
+void hw_target_reset_state(uint8_t target) {
+    memcpy(hw_target_state[target], hw_target_state[HwTargets], hw_target_state_used);
+}
+
+uint32_t hw_busy_loop_cycles_per_1024() {
+    uint32_t timeout = 1024;
+    uint32_t cycles = ARM_DWT_CYCCNT;
+    BUSY_LOOP(hw_measure, timeout);
+    return ARM_DWT_CYCCNT - cycles;
+}
+
+bool hw_critical                = true;
+bool hw_in_critical             = false;
+
+// the i.MX RT1062 has 160 interrupts (5 enable registers)
+constexpr unsigned HwIrqRegs    = 5;
+uint32_t hw_critical_irqs[HwIrqRegs];
+
+FASTRUN void hw_critical_begin() {
+    if (!hw_critical || hw_in_critical) return;
+    hw_in_critical = true;
+    io_defer();
+    for (unsigned i = 0; i < HwIrqRegs; i++) {
+        hw_critical_irqs[i] = (&NVIC_ISER0)[i];
+        (&NVIC_ICER0)[i] = hw_critical_irqs[i];
+    }
+    SYST_CSR &= ~SYST_CSR_TICKINT;
+    asm volatile ("dsb\n\tisb" ::: "memory");
+}
+
+FASTRUN void hw_critical_end() {
+    if (!hw_in_critical) return;
+    SYST_CSR |= SYST_CSR_TICKINT;
+    for (unsigned i = 0; i < HwIrqRegs; i++)
+        (&NVIC_ISER0)[i] = hw_critical_irqs[i];
+    hw_in_critical = false;
+    io_flush();
+}
+
+// per critical setting (off, on)
+struct {
+    uint32_t loops, samples, min, max;
+} hw_jitter[2];
+
+FASTRUN void hw_jitter_record(uint32_t loops, uint32_t cycles) {
+    auto &j = hw_jitter[hw_in_critical];
+    if (j.loops != loops || j.samples == 0) {
+        j.loops = loops;
+        j.samples = 0;
+        j.min = 0xffffffff;
+        j.max = 0;
+    }
+    j.samples++;
+    if (cycles < j.min) j.min = cycles;
+    if (cycles > j.max) j.max = cycles;
+}
+
+bool hw_jitter_show(void * pThis) {
+    println("critical | loops      | samples    | min cycles | max cycles | jitter");
+    println("---------|------------|------------|------------|------------|-----------");
+    for (unsigned i = 0; i < 2; i++) {
+        const auto &j = hw_jitter[i];
+        print_str(i ? "on       | " : "off      | ");
+        print_hex_int(j.loops);
+        print_str(" | ");
+        print_hex_int(j.samples);
+        print_str(" | ");
+        print_hex_int(j.samples ? j.min : 0);
+        print_str(" | ");
+        print_hex_int(j.max);
+        print_str(" | ");
+        print_hex_int(j.samples ? j.max - j.min : 0);
+        println();
+    }
+    return true;
+}
+
+cli_command hw_jitter_cmd = {
+    .name           = "jitter",
+    .description    = hw_jitter_cmd_desc,
+    .pThis          = 0,
+    .exec           = &hw_jitter_show,
+    .next           = 0,
+};
+
 bool hw_trigger_cli             = false;
 bool hw_trigger_attack          = true;
 bool hw_trigger_glitch          = true;
@@ -66,6 +234,7 @@ bool hw_trigger_glitch_success  = false;
 bool hw_trigger_glitch_broken   = false;
 bool hw_trigger_restart         = true;
 
+cli_param_bool hw_critical_this                 = make_cli_param_bool(hw_critical,                  true);
 cli_param_bool hw_trigger_cli_this              = make_cli_param_bool(hw_trigger_cli,               false);
 cli_param_bool hw_trigger_attack_this           = make_cli_param_bool(hw_trigger_attack,            true);
 cli_param_bool hw_trigger_glitch_this           = make_cli_param_bool(hw_trigger_glitch,            true);
@@ -74,7 +243,8 @@ cli_param_bool hw_trigger_glitch_success_this   = make_cli_param_bool(hw_trigger
 cli_param_bool hw_trigger_glitch_broken_this    = make_cli_param_bool(hw_trigger_glitch_broken,     false);
 cli_param_bool hw_trigger_restart_this          = make_cli_param_bool(hw_trigger_restart,           true);
 
-cli_param hw_trigger_cli_param                  = make_cli_param_bool_param("trigger_cli",              hw_trigger_cli_desc,            hw_trigger_cli_this,            0);
+cli_param hw_critical_param                     = make_cli_param_bool_param("critical",                 hw_critical_desc,               hw_critical_this,               0);
+cli_param hw_trigger_cli_param                  = make_cli_param_bool_param("trigger_cli",              hw_trigger_cli_desc,            hw_trigger_cli_this,            &hw_critical_param);
 cli_param hw_trigger_attack_param               = make_cli_param_bool_param("trigger_attack",           hw_trigger_attack_desc,         hw_trigger_attack_this,         &hw_trigger_cli_param);
 cli_param hw_trigger_glitch_param               = make_cli_param_bool_param("trigger_glitch",           hw_trigger_glitch_desc,         hw_trigger_glitch_this,         &hw_trigger_attack_param);
 cli_param hw_trigger_glitch_running_param       = make_cli_param_bool_param("trigger_glitch_running",   hw_trigger_glitch_running_desc, hw_trigger_glitch_running_this, &hw_trigger_glitch_param);
@@ -85,44 +255,97 @@ cli_param hw_trigger_restart_param              = make_cli_param_bool_param("tri
 void hw_trigger_cli_set_high() {            if (hw_trigger_cli) hw.trigger_pin.set_high(); }
 void hw_trigger_cli_set_low() {             if (hw_trigger_cli) hw.trigger_pin.set_low(); }
 
-void hw_trigger_attack_set_high() {         if (hw_trigger_attack) hw.trigger_pin.set_high(); }
-void hw_trigger_attack_set_low() {          if (hw_trigger_attack) hw.trigger_pin.set_low(); }
+void hw_trigger_attack_set_high() {
+    trace_event(trace_attack, 1);
+    if (hw_trigger_attack) hw.trigger_pin.set_high();
+}
+void hw_trigger_attack_set_low() {
+    trace_event(trace_attack, 0);
+    if (hw_trigger_attack) hw.trigger_pin.set_low();
+}
 
-void hw_trigger_glitch_set_high() {         if (hw_trigger_glitch) hw.trigger_pin.set_high(); }
-void hw_trigger_glitch_set_low() {          if (hw_trigger_glitch) hw.trigger_pin.set_low(); }
+void hw_trigger_glitch_set_high() {
+    trace_event(trace_glitch, 1);
+    if (hw_trigger_glitch) hw.trigger_pin.set_high();
+}
+void hw_trigger_glitch_set_low() {
+    trace_event(trace_glitch, 0);
+    if (hw_trigger_glitch) hw.trigger_pin.set_low();
+}
 
-void hw_trigger_glitch_running_set_high() { if (hw_trigger_glitch_running) hw.trigger_pin.set_high(); }
-void hw_trigger_glitch_running_set_low() {  if (hw_trigger_glitch_running) hw.trigger_pin.set_low(); }
+void hw_trigger_glitch_running_set_high() {
+    trace_event(trace_running, 1);
+    if (hw_trigger_glitch_running) hw.trigger_pin.set_high();
+}
+void hw_trigger_glitch_running_set_low() {
+    trace_event(trace_running, 0);
+    if (hw_trigger_glitch_running) hw.trigger_pin.set_low();
+}
 
-void hw_trigger_glitch_success_set_high() { if (hw_trigger_glitch_success) hw.trigger_pin.set_high(); }
-void hw_trigger_glitch_success_set_low() {  if (hw_trigger_glitch_success) hw.trigger_pin.set_low(); }
+void hw_trigger_glitch_success_set_high() {
+    trace_event(trace_success, 1);
+    if (hw_trigger_glitch_success) hw.trigger_pin.set_high();
+}
+void hw_trigger_glitch_success_set_low() {
+    trace_event(trace_success, 0);
+    if (hw_trigger_glitch_success) hw.trigger_pin.set_low();
+}
 
-void hw_trigger_glitch_broken_set_high() {  if (hw_trigger_glitch_broken) hw.trigger_pin.set_high(); }
-void hw_trigger_glitch_broken_set_low() {   if (hw_trigger_glitch_broken) hw.trigger_pin.set_low(); }
+void hw_trigger_glitch_broken_set_high() {
+    trace_event(trace_broken, 1);
+    if (hw_trigger_glitch_broken) hw.trigger_pin.set_high();
+}
+void hw_trigger_glitch_broken_set_low() {
+    trace_event(trace_broken, 0);
+    if (hw_trigger_glitch_broken) hw.trigger_pin.set_low();
+}
 
-void hw_trigger_restart_set_high() {        if (hw_trigger_restart) hw.trigger_pin.set_high(); }
-void hw_trigger_restart_set_low() {         if (hw_trigger_restart) hw.trigger_pin.set_low(); }
+void hw_trigger_restart_set_high() {
+    trace_event(trace_restart, 1);
+    if (hw_trigger_restart) hw.trigger_pin.set_high();
+}
+void hw_trigger_restart_set_low() {
+    trace_event(trace_restart, 0);
+    if (hw_trigger_restart) hw.trigger_pin.set_low();
+}
 
 enum {
     hw_uninited,
     hw_cfg_1,
     hw_cfg_2,
+    hw_cfg_both,
 } hw_cfg_status = hw_uninited;
 
-
-bool hw_cfg_reset(void * pThis) {
+// Deinitializes the hardware of every target, target 1 is selected after.
+void hw_cfg_off() {
+    if (hw_cfg_status == hw_cfg_both) {
+        hw_target_select(1);
+        hw_deinit();
+    }
+    hw_target_select(0);
     if (hw_cfg_status != hw_uninited)
         hw_deinit();
-    hw_init();
+    hw_targets = 1;
+    hw_cli_target = 0;
+    prompt_set_tag("");
+    hw_cfg_status = hw_uninited;
+}
+
+void hw_cfg_init() {
+    hw_init(HwCfg1());
     hw_cfg_status = hw_cfg_1;
+}
+
+bool hw_cfg_reset(void * pThis) {
+    hw_cfg_off();
+    hw_cfg_init();
     return true;
 }
 
 bool hw_cfg_set(void * pThis, const char *value, unsigned n) {
     if (str_cmp(value, n, "1", sizeof("1")) == 0) {
         if (hw_cfg_status != hw_cfg_1) {
-            if (hw_cfg_status != hw_uninited)
-                hw_deinit();
+            hw_cfg_off();
             hw_init(HwCfg1());
             hw_cfg_status = hw_cfg_1;
         }
@@ -130,14 +353,30 @@ bool hw_cfg_set(void * pThis, const char *value, unsigned n) {
     }
     if (str_cmp(value, n, "2", sizeof("2")) == 0) {
         if (hw_cfg_status != hw_cfg_2) {
-            if (hw_cfg_status != hw_uninited)
-                hw_deinit();
+            hw_cfg_off();
             hw_init(HwCfg2());
             hw_cfg_status = hw_cfg_2;
         }
         return true;
     }
-    println("Error: Couldn't parse value, use 1 or 2!");
+    if (str_cmp(value, n, "both", sizeof("both")) == 0) {
+        if (hw_target_state_full) {
+            println("Error: The per-target state doesn't fit, increase HwTargetStateSize!");
+            return false;
+        }
+        if (hw_cfg_status != hw_cfg_both) {
+            hw_cfg_off();
+            hw_targets = 2;
+            hw_init(HwCfg1(), false);
+            hw_target_reset_state(1);
+            hw_target_select(1);
+            hw_init(HwCfg2(), false);
+            hw_target_select(0);
+            hw_cfg_status = hw_cfg_both;
+        }
+        return true;
+    }
+    println("Error: Couldn't parse value, use 1, 2 or both!");
     return false;
 }
 
@@ -147,10 +386,13 @@ bool hw_cfg_print(void * pThis) {
             print_str("uninitialized");
             break;
         case hw_cfg_1:
-            print_str("config 1 (trig=1, rst=2, cs=3, scl_out=19, sda_out=18, scl_in=20, sda_in=21");
+            print_str("config 1 (trig=1, rst=2, cs=3, scl_out=19, sda_out=18, scl_in=20, sda_in=21, spi_cs=10, spi_clk=13, spi_mosi=12");
             break;
         case hw_cfg_2:
-            print_str("config 2 (trig=11, rst=9, cs=10, scl_out=16, sda_out=17, scl_in=15, sda_in=14");
+            print_str("config 2 (trig=11, rst=9, cs=10, scl_out=16, sda_out=17, scl_in=15, sda_in=14, spi_cs=0, spi_clk=27, spi_mosi=1");
+            break;
+        case hw_cfg_both:
+            print_str("both (target 1 on config 1, target 2 on config 2, no spi sniffer)");
             break;
         default:
             print_str("unknown (this should never happen)");
@@ -159,6 +401,316 @@ bool hw_cfg_print(void * pThis) {
     return true;
 }
 
+bool hw_cfg_save(void * pThis) {
+    switch (hw_cfg_status) {
+        case hw_cfg_1:
+            print_str("1");
+            return true;
+        case hw_cfg_2:
+            print_str("2");
+            return true;
+        case hw_cfg_both:
+            print_str("both");
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Sets the baudrate of every target.
+void hw_baudrate_apply() {
+    if (hw_cfg_status == hw_uninited)
+        return;
+    uint8_t target = hw_target;
+    for (uint8_t t = 0; t < hw_targets; t++) {
+        hw_target_select(t);
+        twi_master.set_baudrate(hw_baudrate);
+    }
+    hw_target_select(target);
+}
+
+bool hw_baudrate_set(void * pThis, const char *value, unsigned n) {
+    unsigned baudrate;
+    if (!stou(baudrate, value, n)) {
+        println("Error: Couldn't parse numeric value!");
+        return false;
+    }
+    Twi::Timing t;
+    if (!Twi::Timing::of_baudrate(baudrate, t)) {
+        println("Error: The baudrate can't be reached with the base clock!");
+        return false;
+    }
+    hw_baudrate = baudrate;
+    hw_baudrate_apply();
+    return true;
+}
+
+bool hw_baudrate_reset(void * pThis) {
+    hw_baudrate = DefaultHwBaudrate;
+    hw_baudrate_apply();
+    return true;
+}
+
+bool hw_target_set(void * pThis, const char *value, unsigned n) {
+    unsigned target;
+    if (!stou(target, value, n)) {
+        println("Error: Couldn't parse numeric value!");
+        return false;
+    }
+    if (target < 1 || target > hw_targets) {
+        println("Error: There is no such target (see \"hw config\")!");
+        return false;
+    }
+    hw_cli_target = target - 1;
+    return true;
+}
+
+bool hw_target_reset(void * pThis) {
+    hw_cli_target = 0;
+    return true;
+}
+
+bool hw_target_print(void * pThis) {
+    print_hex_int(hw_cli_target + 1);
+    print_str(" (of ");
+    print_hex_int(hw_targets);
+    print_str(")");
+    return true;
+}
+
+bool hw_baudrate_save(void * pThis) {
+    print_hex_int(hw_baudrate);
+    return true;
+}
+
+bool hw_baudrate_print(void * pThis) {
+    Twi::Timing t;
+    Twi::Timing::of_baudrate(hw_baudrate, t);
+    print_hex_int(hw_baudrate);
+    print_str(" (actually ");
+    print_hex_int(t.baudrate());
+    print_str(")");
+    return true;
+}
+
+// The hot paths with the pins from the hw struct and with the pin policy
+// of the selected configuration (see HW_PINS_CALL).
+constexpr unsigned HwBenchRuns  = 256;
+constexpr uint32_t HwBenchLoops = 16;
+
+volatile bool hw_bench_sink;
+
+void __attribute__((noinline)) hw_bench_poll_struct() {
+    hw_bench_sink = hw.cs_pin.is_low() && hw.cs_pin.is_low();
+}
+
+// the same from the flash (through the instruction cache)
+FLASHMEM void __attribute__((noinline)) hw_bench_poll_flash() {
+    hw_bench_sink = hw.cs_pin.is_low() && hw.cs_pin.is_low();
+}
+
+template <class PINS>
+void __attribute__((noinline)) hw_bench_poll_fixed() {
+    typename PINS::cs_pin cs_pin;
+    hw_bench_sink = cs_pin.is_low() && cs_pin.is_low();
+}
+
+// HwBenchLoops loops (unless chip-select changes)
+void __attribute__((noinline)) hw_bench_wait_struct() {
+    uint32_t timeout = HwBenchLoops;
+    if (hw.cs_pin.is_high())
+        BUSY_LOOP_WHILE_PIN_HIGH(bench_high, timeout, hw.cs_pin);
+    else
+        BUSY_LOOP_WHILE_PIN_LOW(bench_low, timeout, hw.cs_pin);
+}
+
+template <class PINS>
+void __attribute__((noinline)) hw_bench_wait_fixed() {
+    typename PINS::cs_pin cs_pin;
+    uint32_t timeout = HwBenchLoops;
+    if (cs_pin.is_high())
+        BUSY_LOOP_WHILE_PIN_HIGH(bench_high, timeout, cs_pin);
+    else
+        BUSY_LOOP_WHILE_PIN_LOW(bench_low, timeout, cs_pin);
+}
+
+void __attribute__((noinline)) hw_bench_trigger_struct() {
+    hw_trigger_glitch_set_high();
+    hw_trigger_glitch_set_low();
+}
+
+template <class PINS>
+void __attribute__((noinline)) hw_bench_trigger_fixed() {
+    hw_trigger_set_high<PINS>(hw_trigger_glitch, trace_glitch);
+    hw_trigger_set_low<PINS>(hw_trigger_glitch, trace_glitch);
+}
+
+void hw_bench_run(const char *name, const char *access, void (*bench)()) {
+    uint32_t min = 0xffffffff, max = 0;
+    uint64_t sum = 0;
+
+    hw_critical_begin();
+
+    // the first run with an empty instruction cache (like the first glitch
+    // after a while of cli activity), then the steady state
+    SCB_CACHE_ICIALLU = 0;
+    asm volatile ("dsb\n isb");
+    uint32_t start = ARM_DWT_CYCCNT;
+    bench();
+    uint32_t first = ARM_DWT_CYCCNT - start;
+
+    for (unsigned i = 0; i < HwBenchRuns; i++) {
+        uint32_t start = ARM_DWT_CYCCNT;
+        bench();
+        uint32_t cycles = ARM_DWT_CYCCNT - start;
+        sum += cycles;
+        if (cycles < min) min = cycles;
+        if (cycles > max) max = cycles;
+    }
+    hw_critical_end();
+
+    print_str(name);
+    for (unsigned i = str_len(name, 10); i < 10; i++)
+        print_str(" ");
+    print_str(" | ");
+    print_str(access);
+    print_str(" | ");
+    print_hex_int(first);
+    print_str(" | ");
+    print_hex_int(min);
+    print_str(" | ");
+    print_hex_int(max);
+    print_str(" | ");
+    print_hex_int(sum / HwBenchRuns);
+    println();
+}
+
+bool hw_bench(void * pThis) {
+
+    if (hw_cfg_status == hw_uninited) {
+        println("Error: The hardware isn't initialized!");
+        return false;
+    }
+
+    // the trigger pulses aren't traced
+    bool trace = trace_enabled;
+    trace_enabled = false;
+
+    const bool cfg2 = hw.pins == hw_pins_2;
+
+    println("bench      | access | first      | min cycles | max cycles | avg cycles");
+    println("-----------|--------|------------|------------|------------|-----------");
+    hw_bench_run("cs poll",     "flash ",   &hw_bench_poll_flash);
+    hw_bench_run("cs poll",     "struct",   &hw_bench_poll_struct);
+    hw_bench_run("cs poll",     "policy",   cfg2 ? &hw_bench_poll_fixed<HwPins2> : &hw_bench_poll_fixed<HwPins1>);
+    hw_bench_run("cs wait",     "struct",   &hw_bench_wait_struct);
+    hw_bench_run("cs wait",     "policy",   cfg2 ? &hw_bench_wait_fixed<HwPins2> : &hw_bench_wait_fixed<HwPins1>);
+    hw_bench_run("trigger",     "struct",   &hw_bench_trigger_struct);
+    hw_bench_run("trigger",     "policy",   cfg2 ? &hw_bench_trigger_fixed<HwPins2> : &hw_bench_trigger_fixed<HwPins1>);
+
+    trace_enabled = trace;
+    return true;
+}
+
+cli_command hw_bench_cmd = {
+    .name           = "bench",
+    .description    = hw_bench_cmd_desc,
+    .pThis          = 0,
+    .exec           = &hw_bench,
+    .next           = &hw_jitter_cmd,
+};
+
+uint32_t hw_tune_min            = DefaultHwTuneMin;
+uint32_t hw_tune_max            = DefaultHwTuneMax;
+uint32_t hw_tune_packets        = DefaultHwTunePackets;
+
+bool hw_tune(void * pThis) {
+
+    if (hw_cfg_status == hw_uninited) {
+        println("Error: The hardware isn't initialized!");
+        return false;
+    }
+
+    CommandRaw raw = core_cmd.to_raw();
+
+    println("baudrate   | verified");
+    println("-----------|-----------");
+
+    // one base clock cycle per bit more at a time
+    const uint32_t first = (I2C_BASE_CLK + hw_tune_max - 1) / hw_tune_max;
+    const uint32_t last = I2C_BASE_CLK / hw_tune_min;
+    for (uint32_t cycles = first; cycles <= last; cycles++) {
+
+        const uint32_t baudrate = I2C_BASE_CLK / cycles;
+        if (!twi_master.set_baudrate(baudrate))
+            continue;
+
+        uint32_t verified = 0;
+        for (uint32_t i = 0; i < hw_tune_packets; i++) {
+            bool ok;
+            hw_critical_begin();
+            int rc = sniff_send_verified(raw, ok);
+            hw_critical_end();
+            if (rc >= 0 && ok)
+                verified++;
+        }
+
+        print_hex_int(baudrate);
+        print_str(" | ");
+        print_hex_int(verified);
+        println();
+
+        if (verified == hw_tune_packets) {
+            hw_baudrate = baudrate;
+            hw_baudrate_apply();
+            print_hex_param("hw baudrate", hw_baudrate, int);
+            return true;
+        }
+    }
+
+    twi_master.set_baudrate(hw_baudrate);
+    println("Error: No baudrate passed, the baudrate wasn't changed!");
+    return false;
+}
+
+cli_param_u32 hw_tune_min_this      = make_cli_param_u32(hw_tune_min,       DefaultHwTuneMin,       1, I2C_BASE_CLK);
+cli_param_u32 hw_tune_max_this      = make_cli_param_u32(hw_tune_max,       DefaultHwTuneMax,       1, I2C_BASE_CLK);
+cli_param_u32 hw_tune_packets_this  = make_cli_param_u32(hw_tune_packets,   DefaultHwTunePackets,   1, 0xffffffff);
+
+cli_param hw_tune_packets_param = make_cli_param_u32_param("tune_packets",   hw_tune_packets_desc,   hw_tune_packets_this,   &hw_trigger_restart_param);
+cli_param hw_tune_max_param     = make_cli_param_u32_param("tune_max",       hw_tune_max_desc,       hw_tune_max_this,       &hw_tune_packets_param);
+cli_param hw_tune_min_param     = make_cli_param_u32_param("tune_min",       hw_tune_min_desc,       hw_tune_min_this,       &hw_tune_max_param);
+
+cli_param hw_baudrate_param = {
+    .name           = "baudrate",
+    .description    = hw_baudrate_desc,
+    .pThis          = 0,
+    .set            = &hw_baudrate_set,
+    .reset          = &hw_baudrate_reset,
+    .print          = &hw_baudrate_print,
+    .next           = &hw_tune_min_param,
+    .save           = &hw_baudrate_save,
+};
+
+cli_param hw_target_param = {
+    .name           = "target",
+    .description    = hw_target_desc,
+    .pThis          = 0,
+    .set            = &hw_target_set,
+    .reset          = &hw_target_reset,
+    .print          = &hw_target_print,
+    .next           = &hw_baudrate_param,
+    .save           = &cli_param_no_save,
+};
+
+cli_command hw_tune_cmd = {
+    .name           = "tune",
+    .description    = hw_tune_cmd_desc,
+    .pThis          = 0,
+    .exec           = &hw_tune,
+    .next           = &hw_bench_cmd,
+};
+
 cli_param hw_cfg_param = {
     .name           = "config",
     .description    = hw_cfg_desc,
@@ -166,14 +718,15 @@ cli_param hw_cfg_param = {
     .set            = &hw_cfg_set,
     .reset          = &hw_cfg_reset,
     .print          = &hw_cfg_print,
-    .next           = &hw_trigger_restart_param,
+    .next           = &hw_target_param,
+    .save           = &hw_cfg_save,
 };
 
 cli_module hw_module = {
     .name           = "hw",
     .description    = hw_mod_desc,
     .param          = &hw_cfg_param,
-    .cmd            = 0,
+    .cmd            = &hw_tune_cmd,
     .next           = 0,
 };
 
@@ -16,10 +16,14 @@
 #ifndef HW_H
 #define HW_H
 
+#include <avr/pgmspace.h>
+
 #include "teensy_pins.hpp"
 #include "teensy_twi.hpp"
+#include "teensy_spi.hpp"
 
 #include "cli.h"
+#include "trace.h"
 
 using namespace Teensy;
 
@@ -32,7 +36,8 @@ using namespace Teensy;
     "Controls which hardware components are used and how."
 
 #define hw_cfg_desc \
-    "Allows switching between the two configurations (1 and 2).\r\n" \
+    "Allows switching between the two configurations (1 and 2), or\r\n" \
+    "using both at once for two targets (both, see \"hw target\").\r\n" \
     "                  cfg 1   cfg 2  \r\n" \
     "  ===============================\r\n" \
     "    trigger pin |     0 |     9 |\r\n" \
@@ -41,7 +46,16 @@ using namespace Teensy;
     "     svc in pin |    20 |    15 |\r\n" \
     "     svd in pin |    21 |    14 |\r\n" \
     "    svc out pin |    19 |    16 |\r\n" \
-    "    svd out pin |    18 |    17 |"
+    "    svd out pin |    18 |    17 |\r\n" \
+    "     spi cs pin |    10 |     0 |\r\n" \
+    "    spi clk pin |    13 |    27 |\r\n" \
+    "   spi mosi pin |    12 |     1 |\r\n" \
+    "The spi pins of one config overlap the pins of the other, so both\r\n" \
+    "targets run without spi sniffer (no address triggers)."
+#define hw_target_desc \
+    "The target (1 or 2) the commands and the output apply to, if both\r\n" \
+    "configurations are used. The parameters are shared, the state of\r\n" \
+    "the attack, glitch, restart and trigger modules is per target."
 #define hw_trigger_cli_desc \
     "Whether the trigger pin pulses on cli activity (for debugging)."
 #define hw_trigger_attack_desc \
@@ -60,6 +74,36 @@ using namespace Teensy;
     "Whether the trigger pin pulses on a restart of the device\r\n" \
     "under test."
 
+#define hw_critical_desc \
+    "Whether the interrupts are masked and the output is deferred while\r\n" \
+    "a triggered attack or glitch is carried out (until the last\r\n" \
+    "cooldown, not while waiting for the outcome)."
+#define hw_baudrate_desc \
+    "The baudrate of the injection bus in bits per second (the closest one\r\n" \
+    "the base clock allows is used, see \"hw tune\")."
+#define hw_tune_min_desc \
+    "The slowest baudrate tried by \"hw tune\"."
+#define hw_tune_max_desc \
+    "The fastest baudrate tried by \"hw tune\"."
+#define hw_tune_packets_desc \
+    "How many packets must be read back unchanged and acknowledged at a\r\n" \
+    "baudrate in \"hw tune\"."
+#define hw_tune_cmd_desc \
+    "Tries the baudrates from tune_max down to tune_min. At every baudrate\r\n" \
+    "the core_cmd is sent tune_packets times and read back on the svc/svd\r\n" \
+    "input pins. The fastest baudrate at which every packet was seen\r\n" \
+    "unchanged and was acknowledged by the voltage regulator is kept."
+#define hw_bench_cmd_desc \
+    "Runs the pin accesses of the hot paths (polling chip-select, waiting\r\n" \
+    "for it in a busy loop, a glitch trigger pulse) with the pins from the\r\n" \
+    "hw struct and with the pin policy of the config (like the attack\r\n" \
+    "code), the chip-select poll also from the flash. Prints the cpu\r\n" \
+    "cycles of the first run (with an empty instruction cache) and of the\r\n" \
+    "256 runs after it."
+#define hw_jitter_cmd_desc \
+    "Prints the spread of the cpu cycles the glitch delay took, with and\r\n" \
+    "without critical section (since the delay was last changed)."
+
 extern cli_module hw_module;
 
 
@@ -67,51 +111,95 @@ extern cli_module hw_module;
 // Hardware configuration //
 ////////////////////////////
 
+// the pin policy of a configuration (see HwPins1)
+enum hw_pins : uint8_t {
+    hw_pins_1,
+    hw_pins_2,
+};
+
 typedef struct {
+    uint8_t         pins;
     Gpio::Hardware  trigger_pin;
     Gpio::Hardware  cs_pin;
     Gpio::Hardware  reset_pin;
     Gpio::Hardware  scl_in_pin;
     Gpio::Hardware  sda_in_pin;
     Twi::Hardware   twi_hardware;
+    Spi::Hardware   spi_hardware;
 } hardware_config;
 
 inline hardware_config HwCfg1() {
     return {
+        .pins           = hw_pins_1,
         .trigger_pin    = Gpio0(),
         .cs_pin         = Gpio1(),
         .reset_pin      = Gpio2(),
         .scl_in_pin     = Gpio20(),
         .sda_in_pin     = Gpio21(),
         .twi_hardware   = Twi::Hardware::Pins_19_18,
+        .spi_hardware   = Spi::Hardware::Pins_10_13_12,
     };
 }
 
 inline hardware_config HwCfg2() {
     return {
+        .pins           = hw_pins_2,
         .trigger_pin    = Gpio9(),
         .cs_pin         = Gpio10(),
         .reset_pin      = Gpio11(),
         .scl_in_pin     = Gpio15(),
         .sda_in_pin     = Gpio14(),
         .twi_hardware   = Twi::Hardware::Pins_16_17,
+        .spi_hardware   = Spi::Hardware::Pins_0_27_1,
     };
 }
 
+// Pin policies: the pins of the hot paths as types. Code instantiated with a
+// policy has the register addresses and masks as immediates, HW_PINS_CALL
+// calls the instance for the pins of the selected target.
+struct HwPins1 {
+    typedef FixedGpio0  trigger_pin;
+    typedef FixedGpio1  cs_pin;
+    typedef FixedGpio20 scl_in_pin;
+    typedef FixedGpio21 sda_in_pin;
+};
+
+struct HwPins2 {
+    typedef FixedGpio9  trigger_pin;
+    typedef FixedGpio10 cs_pin;
+    typedef FixedGpio15 scl_in_pin;
+    typedef FixedGpio14 sda_in_pin;
+};
+
+#define HW_PINS_CALL(FN, ...) \
+    (hw.pins == hw_pins_2 ? FN<HwPins2>(__VA_ARGS__) : FN<HwPins1>(__VA_ARGS__))
+
 // TODO remove this
 constexpr uint32_t twi_timeout = 60000000;
 
+constexpr uint32_t DefaultHwBaudrate        = I2C_BAUDRATE;
+constexpr uint32_t DefaultHwTuneMin         = 1000000;
+constexpr uint32_t DefaultHwTuneMax         = 8000000;
+constexpr uint32_t DefaultHwTunePackets     = 32;
+
 
 ////////////////////////
 // Hardware Interface //
 ////////////////////////
 
 extern Twi::Master twi_master;
+extern Spi::Sniffer spi_sniffer;
 extern hardware_config hw;
 
-void hw_init(hardware_config cfg = HwCfg1());
+void hw_init(hardware_config cfg = HwCfg1(), bool spi = true);
+
+// Initializes the default configuration (see "hw config") at boot.
+void hw_cfg_init();
 void hw_deinit();
 
+// whether the spi sniffer of the selected target is set up
+extern bool hw_spi_enabled;
+
 void hw_trigger_cli_set_high();
 void hw_trigger_cli_set_low();
 
@@ -133,6 +221,79 @@ void hw_trigger_glitch_running_set_low();
 void hw_trigger_restart_set_high();
 void hw_trigger_restart_set_low();
 
+// The same for code instantiated with a pin policy, e.g.
+//   hw_trigger_set_high<PINS>(hw_trigger_glitch, trace_glitch);
+template <class PINS>
+inline void hw_trigger_set_high(bool enabled, uint8_t signal) {
+    trace_event(signal, 1);
+    PINS::trigger_pin::set_high_if(enabled);
+}
+
+template <class PINS>
+inline void hw_trigger_set_low(bool enabled, uint8_t signal) {
+    trace_event(signal, 0);
+    PINS::trigger_pin::set_low_if(enabled);
+}
+
+extern bool hw_trigger_cli;
+extern bool hw_trigger_attack;
+extern bool hw_trigger_glitch;
+extern bool hw_trigger_glitch_running;
+extern bool hw_trigger_glitch_success;
+extern bool hw_trigger_glitch_broken;
+extern bool hw_trigger_restart;
+
+
+/////////////////////
+// Target contexts //
+/////////////////////
+
+/*
+
+With "hw config both" both configurations are used at once, one target each.
+The modules keep the state of an attack in globals, the state of the target
+that isn't selected is saved by the hw module. A module hands a list of its
+per-target variables to hw_target_vars_append() and hw_target_select() swaps
+them all (so keep the lists short, the main loop switches all the time).
+
+*/
+
+constexpr unsigned HwTargets            = 2;
+// bytes of saved per-target state
+constexpr unsigned HwTargetStateSize    = 1024;
+
+typedef struct hw_target_var {
+    void                    *ptr;
+    uint32_t                size;
+    uint32_t                offset;     // in the saved state (set by append)
+    struct hw_target_var    *next;
+} hw_target_var;
+
+#define make_hw_target_var(VAR, NEXT) \
+{                           \
+    .ptr    = &VAR,         \
+    .size   = sizeof(VAR),  \
+    .offset = 0,            \
+    .next   = NEXT,         \
+}
+
+// The current values become the initial state of both targets, so this
+// must be called before the cli runs. If a list doesn't fit the saved state,
+// "hw config both" is refused.
+void hw_target_vars_append(hw_target_var &vars);
+
+// the selected target (its state is in the globals)
+extern uint8_t hw_target;
+// the number of targets in use (2 with "hw config both")
+extern uint8_t hw_targets;
+// the target the cli applies to
+extern uint8_t hw_cli_target;
+
+void hw_target_select(uint8_t target);
+
+// the variables of the hw module (hw, twi_master, spi_sniffer)
+extern hw_target_var hw_target_vars;
+
 
 ////////////////
 // busy loops //
@@ -155,21 +316,42 @@ constexpr uint32_t rough_busy_wait_ms(uint32_t ms) {
     return ms * 60000;
 }
 
+// The glitch engine (the glitch, the attack waits, sending packets) is
+// placed in ITCM explicitly (FASTRUN), its state is in DTCM (the default of
+// .data and .bss). Neither goes through the caches or waits for the flash,
+// "make check-tcm" fails if a symbol listed in the Makefile moved elsewhere.
+
+// cpu cycles of 1024 busy loop cycles (measured with the cycle counter)
+uint32_t hw_busy_loop_cycles_per_1024();
+
+// If hw critical is set, the critical section masks all interrupts (the
+// usb serial and the systick included, millis() stands still) and defers
+// the output until its end. glitch_on ends it after the last cooldown.
+void hw_critical_begin();
+void hw_critical_end();
+
+// records how many cpu cycles a busy loop of the given length took
+// (for the jitter report of "hw jitter")
+void hw_jitter_record(uint32_t loops, uint32_t cycles);
+
+// Note: the labels are numbered per asm statement (%=), so the loops
+//       can be used in templates (see HwPins1)
+
 // Note: the use of memory ensures that the timing
 //       is simliar to the busy loops with conditions
 #define BUSY_LOOP(UID, TIMEOUT) \
     asm volatile ( \
-"_busy_loop_" #UID ":\n" \
+"_busy_loop_" #UID "_%=:\n" \
 /* while ((TIMEOUT--) */ \
-"   cbz %0, _busy_loop_end_" #UID "\n" \
+"   cbz %0, _busy_loop_end_" #UID "_%=\n" \
 "   sub %0, %0, #1\n" \
 /* timing adjustments */ \
 "   ldr r1, [%1]\n" \
 "   tst r1, %0\n" \
-"   b _busy_loop_" #UID "\n" \
-"_busy_loop_end_" #UID ":\n" \
+"   b _busy_loop_" #UID "_%=\n" \
+"_busy_loop_end_" #UID "_%=:\n" \
     : /* no outputs */ \
-    : "r"(TIMEOUT), "r"(&hw.cs_pin.regs->PSR) \
+    : "r"(TIMEOUT), "r"(hw.cs_pin.psr()) \
     : "r1")
 
 // If TIMEOUT == 0 afterwards then a timeout happened.
@@ -182,21 +364,21 @@ constexpr uint32_t rough_busy_wait_ms(uint32_t ms) {
 
 #define __BUSY_LOOP_WHILE_PIN(UID, TIMEOUT, PIN, CB) \
     asm volatile ( \
-"_busy_loop_" #UID ":\n" \
+"_busy_loop_" #UID "_%=:\n" \
 /* while ((TIMEOUT--) */ \
-"   cbz %0, _busy_loop_end_" #UID "\n" \
+"   cbz %0, _busy_loop_end_" #UID "_%=\n" \
 "   sub %0, %0, #1\n" \
 /* && (PIN.is_???() */ \
 "   ldr r1, [%2]\n" \
 "   tst r1, %3\n" \
-"   " #CB " _busy_loop_" #UID "\n" \
+"   " #CB " _busy_loop_" #UID "_%=\n" \
 /* || PIN.is_???())); */ \
 "   ldr r1, [%2]\n" \
 "   tst r1, %3\n" \
-"   " #CB " _busy_loop_" #UID "\n" \
-"_busy_loop_end_" #UID ":\n" \
+"   " #CB " _busy_loop_" #UID "_%=\n" \
+"_busy_loop_end_" #UID "_%=:\n" \
     : "=r"(TIMEOUT) \
-    : "0"(TIMEOUT), "r"(&PIN.regs->PSR), "r"(PIN.mask) \
+    : "0"(TIMEOUT), "r"(PIN.psr()), "r"(PIN.mask) \
     : "r1")
 
 
@@ -34,15 +34,74 @@ char get_char() { return Serial.read(); }
 
 // OUTPUT
 
-void print_char(char c) { Serial.write(c); }
+bool        io_deferred = false;
+char        io_defer_queue[IoDeferSize];
+unsigned    io_defer_len = 0;
+unsigned    io_defer_dropped = 0;
+
+char        *io_capture_buffer = 0;
+unsigned    io_capture_size = 0;
+unsigned    io_capture_len = 0;
+
+void io_write(const char * str, unsigned n) {
+    if (io_capture_buffer) {
+        for (unsigned i = 0; i < n; i++) {
+            if (io_capture_len >= io_capture_size) {
+                io_capture_len = io_capture_size + 1;
+                return;
+            }
+            io_capture_buffer[io_capture_len++] = str[i];
+        }
+        return;
+    }
+    if (!io_deferred) {
+        Serial.write(str, n);
+        return;
+    }
+    for (unsigned i = 0; i < n; i++) {
+        if (io_defer_len == IoDeferSize) {
+            io_defer_dropped += n - i;
+            return;
+        }
+        io_defer_queue[io_defer_len++] = str[i];
+    }
+}
+
+void io_defer() { io_deferred = true; }
+
+void io_flush() {
+    io_deferred = false;
+    if (io_defer_len)
+        Serial.write(io_defer_queue, io_defer_len);
+    io_defer_len = 0;
+    if (io_defer_dropped) {
+        print_str("Warning: ");
+        print_hex_int(io_defer_dropped);
+        println(" bytes of deferred output were dropped!");
+        io_defer_dropped = 0;
+    }
+}
+
+void io_capture(char *buffer, unsigned size) {
+    io_capture_buffer = buffer;
+    io_capture_size = size;
+    io_capture_len = 0;
+}
+
+unsigned io_capture_end() {
+    io_capture_buffer = 0;
+    return io_capture_len;
+}
+
+void print_char(char c) { io_write(&c, 1); }
 
-void print_str(const char * str) { Serial.write(str); }
+void print_str(const char * str) { io_write(str, str_len(str)); }
 
-void print_str(const char * str, int n) { Serial.write(str, n); }
+void print_str(const char * str, int n) { io_write(str, n); }
 
-void println(const char * str) { Serial.println(str); }
+void println(const char * str) { print_str(str); println(); }
 
-void println() { Serial.println(); }
+void println() { io_write("\r\n", 2); }
 
 void print_with_indent(unsigned indent, const char *s) {
     while (*s) {
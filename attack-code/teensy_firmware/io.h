@@ -30,6 +30,21 @@ char get_char();
 
 // OUTPUT
 
+// While the output is deferred, everything printed is kept in a RAM
+// queue (the output beyond IoDeferSize bytes is dropped) until io_flush.
+constexpr unsigned IoDeferSize = 4096;
+
+void io_defer();
+void io_flush();
+
+// While captured, everything printed is written to the buffer instead of
+// the serial port (the output beyond size bytes is dropped).
+void io_capture(char *buffer, unsigned size);
+
+// Ends the capture, returns the captured length (or size + 1 if output
+// was dropped).
+unsigned io_capture_end();
+
 void print_char(char c);
 
 void print_str(const char * str);
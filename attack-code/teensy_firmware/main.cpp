@@ -25,16 +25,58 @@
 
 #include "amd_cmds.h"
 #include "attack.h"
+#include "trigger.h"
 #include "glitch.h"
+#include "rail.h"
+#include "timing.h"
 #include "restart.h"
 #include "ping.h"
+#include "sched.h"
+#include "stats.h"
+#include "trace.h"
+#include "config.h"
 
 using namespace Teensy;
 
+cli_module *modules = 0;
+
+void restart_glitch_task() {
+    if (restart_update_status() == dut_running) {
+        glitch_process_trigger();
+    }
+}
+
+void cli_task() {
+    // the cli works on its own target (see "hw target")
+    uint8_t target = hw_target;
+    hw_target_select(hw_cli_target);
+
+    prompt_action action = prompt_handle_input();
+
+    if (action == prompt_action_execute) {
+        unsigned n;
+        char * cmd = prompt_get_line(n);
+
+        prompt_reply(cli_exec(cmd, n, modules));
+    }
+
+    if (target < hw_targets)
+        hw_target_select(target);
+}
+
+// trigger handling
+sched_task restart_glitch_sched = make_sched_task("restart",    restart_glitch_task,    sched_high, 0);
+sched_task attack_sched         = make_sched_task("attack",     attack_process_trigger, sched_high, 0);
+sched_task trigger_sched        = make_sched_task("trigger",    trigger_process,        sched_high, 0);
+// everything else
+sched_task reset_sched          = make_sched_task("reset",      restart_process,        sched_low,  0);
+sched_task timing_sched         = make_sched_task("timing",     timing_process,         sched_low,  10);
+sched_task cli_sched            = make_sched_task("cli",        cli_task,               sched_low,  0);
+
 extern "C" int main(void) {
 
     io_init();
-    hw_init();
+    hw_cfg_init();
 
     hw_trigger_cli_set_high();
 
@@ -45,36 +87,47 @@ extern "C" int main(void) {
     print_str(  "Welcome type \"help\" for help!\r\n");
 
 
-    cli_module *modules = 0;
     cli_modules_append(modules, attack_module);
+    cli_modules_append(modules, trigger_module);
     cli_modules_append(modules, glitch_module);
+    cli_modules_append(modules, rail_module);
+    cli_modules_append(modules, timing_module);
     cli_modules_append(modules, restart_module);
     cli_modules_append(modules, cmd_module);
     cli_modules_append(modules, soc_cmd_module);
     cli_modules_append(modules, core_cmd_module);
     cli_modules_append(modules, hw_module);
     cli_modules_append(modules, ping_module);
-
-    prompt_action action = prompt_action_none;
+    cli_modules_append(modules, sched_module);
+    cli_modules_append(modules, stats_module);
+    cli_modules_append(modules, trace_module);
+    cli_modules_append(modules, prompt_module);
+    cli_modules_append(modules, config_module);
+
+    sched_tasks_append(restart_glitch_sched);
+    sched_tasks_append(attack_sched);
+    sched_tasks_append(trigger_sched);
+    sched_tasks_append(reset_sched);
+    sched_tasks_append(timing_sched);
+    sched_tasks_append(cli_sched);
+
+    hw_target_vars_append(hw_target_vars);
+    hw_target_vars_append(sched_target_vars);
+    hw_target_vars_append(attack_target_vars);
+    hw_target_vars_append(trigger_target_vars);
+    hw_target_vars_append(glitch_target_vars);
+    hw_target_vars_append(restart_target_vars);
 
     while (true) {
-        if (action == prompt_action_none) {
+        // a round per target (one unless "hw config both")
+        for (uint8_t target = 0; target < hw_targets; target++) {
+            hw_target_select(target);
+
             hw_trigger_cli_set_low();
-            if (restart_update_status() == dut_running) {
-                glitch_process_trigger();
-            }
-            attack_process_trigger();
+            sched_run_high();
             hw_trigger_cli_set_high();
-        }
 
-        if (action == prompt_action_execute) {
-            unsigned n;
-            char * cmd = prompt_get_line(n);
-            
-            cli_exec(cmd, n, modules);
+            sched_run_low();
         }
-
-        action = prompt_handle_input();
     }
 }
-
@@ -18,17 +18,23 @@
 
 #include "io.h"
 
-#ifndef LINE_COUNT
-#   define LINE_COUNT 128
+// bytes of the history (every line takes its length plus 4 bytes)
+#ifndef HISTORY_SIZE
+#   define HISTORY_SIZE 8192
 #endif
 #ifndef LINE_SIZE
-#   define LINE_SIZE 1024
+#   define LINE_SIZE 4096
 #endif
 
 
 // Whether the output is currently controlled by the prompt module
 bool prompt_active = false;
 
+bool prompt_machine = false;
+
+// Whether there was output since the last reply (machine mode)
+bool prompt_pending = false;
+
 
 // OUTPUT
 
@@ -181,43 +187,76 @@ void current_line_delete() {
 
 // LINE BUFFER
 
-char lines[LINE_COUNT][LINE_SIZE];
+// The lines are stored one after another in a ring buffer, every line as
+// its length (2 bytes), its chars and its length again (2 bytes), so the
+// buffer can be walked in both directions. The oldest lines are dropped
+// to make room for new ones.
 
-unsigned first_line = 0;
-unsigned last_line = 0xffffffff;
-unsigned this_line = 0;
+static_assert(HISTORY_SIZE >= 8, "HISTORY_SIZE is too small");
+static_assert(LINE_SIZE < 0x10000, "the line length has to fit 16 bits");
 
-// needs to be called before any other method is used
-// - moves last_line to a fresh (empty) line
-// - increase first line if necessary
-// - points this_line to last_line
-void line_buffer_new_last_line() {
+char lines[HISTORY_SIZE];
 
-    if (last_line == 0xffffffff)
-        // initialization
-        last_line = 0;
-    else {
-        // increase is simple
-        if (last_line < LINE_COUNT-1)
-            last_line++;
-        else
-            last_line = 0;
-
-        // increase first line if needed
-        if (last_line == first_line) {
-            // increase first line
-            if (first_line < LINE_COUNT-1)
-                first_line++;
-            else
-                first_line = 0;
-        }
+unsigned lines_used = 0;    // 0 if there are no lines yet
+unsigned first_line = 0;    // offset of the oldest line
+unsigned last_line = 0;     // offset of the newest line
+unsigned lines_end = 0;     // offset after the newest line
+unsigned this_line = 0;     // offset of the shown line
+
+inline char line_buffer_get(unsigned off) {
+    return lines[off % HISTORY_SIZE];
+}
+
+inline void line_buffer_put(unsigned off, char c) {
+    lines[off % HISTORY_SIZE] = c;
+}
+
+inline unsigned line_buffer_len(unsigned off) {
+    return (uint8_t) line_buffer_get(off) | (uint8_t) line_buffer_get(off + 1) << 8;
+}
+
+inline unsigned line_buffer_next(unsigned off) {
+    return (off + line_buffer_len(off) + 4) % HISTORY_SIZE;
+}
+
+inline unsigned line_buffer_previous(unsigned off) {
+    // the length of the previous line is stored right before this line
+    unsigned n = line_buffer_len(off + HISTORY_SIZE - 2);
+    return (off + HISTORY_SIZE - n - 4) % HISTORY_SIZE;
+}
+
+// adds a line after the newest line (dropping the oldest lines if needed)
+void line_buffer_push(const char *s, unsigned n) {
+
+    if (n + 4 > HISTORY_SIZE)
+        n = HISTORY_SIZE - 4;
+
+    while (lines_used && lines_used + n + 4 > HISTORY_SIZE) {
+        lines_used -= line_buffer_len(first_line) + 4;
+        first_line = line_buffer_next(first_line);
     }
+    if (!lines_used)
+        first_line = lines_end;
 
-    // set this line to last line
-    this_line = last_line;
+    line_buffer_put(lines_end, n);
+    line_buffer_put(lines_end + 1, n >> 8);
+    for (unsigned i = 0; i < n; i++)
+        line_buffer_put(lines_end + 2 + i, s[i]);
+    line_buffer_put(lines_end + 2 + n, n);
+    line_buffer_put(lines_end + 3 + n, n >> 8);
 
-    // empty the line
-    lines[last_line][0] = 0;
+    last_line = lines_end;
+    lines_end = (lines_end + n + 4) % HISTORY_SIZE;
+    lines_used += n + 4;
+}
+
+// needs to be called before any other method is used
+// - adds a fresh (empty) last line
+// - drops the oldest lines if necessary
+// - points this_line to last_line
+void line_buffer_new_last_line() {
+    line_buffer_push("", 0);
+    this_line = last_line;
 }
 
 // sets the contents of last line
@@ -225,16 +264,34 @@ void line_buffer_set_last_line(const char *s, unsigned n) {
     n = str_len(s, n);
     if (n >= LINE_SIZE)
         n = LINE_SIZE - 1;
-    char * line = lines[last_line];
-    for (unsigned i = 0; i < n; i++)
-        line[i] = s[i];
-    line[n] = 0;
+
+    // replace the last line (it is the last one in the buffer)
+    bool is_this = this_line == last_line;
+    lines_used -= line_buffer_len(last_line) + 4;
+    lines_end = last_line;
+    line_buffer_push(s, n);
+    if (is_this)
+        this_line = last_line;
 }
 
 void line_buffer_set_last_line_to_current_line() {
     line_buffer_set_last_line(current_line, LINE_SIZE);
 }
 
+// sets current_line to the line at off
+void line_buffer_load(unsigned off) {
+    unsigned n = line_buffer_len(off);
+    if (n >= LINE_SIZE)
+        n = LINE_SIZE - 1;
+    for (unsigned i = 0; i < n; i++)
+        current_line[i] = line_buffer_get(off + 2 + i);
+    current_line[n] = 0;
+    current_line_fill = n;
+    current_line_pos = n;
+    if (prompt_active)
+        current_line_print();
+}
+
 // - copies current_line to last_line if this_line == last_line
 // - moves this_line to it's predecessor
 // - sets current_line to this_line if changes occured
@@ -243,37 +300,22 @@ void line_buffer_move_to_previous_line() {
     if (this_line == last_line)
         line_buffer_set_last_line_to_current_line();
 
-    if (first_line < this_line) {
-        this_line--;
-    } else if (this_line < first_line) {
-        if (this_line == 0)
-            this_line = LINE_COUNT-1;
-        else
-            this_line--;
-    } else {
-        // this_line == first_line
+    if (this_line == first_line)
         return;
-    }
 
-    current_line_set(lines[this_line], LINE_SIZE);
+    this_line = line_buffer_previous(this_line);
+    line_buffer_load(this_line);
 }
 
 // - moves this_line to it's successor
 // - sets current_line to this_line if changes occured
 void line_buffer_move_to_next_line() {
-    if (this_line < last_line) {
-        this_line++;
-    } else if (last_line < this_line) {
-        if (this_line == LINE_COUNT-1)
-            this_line = 0;
-        else
-            this_line++;
-    } else {
-        // this_line == last_line
+
+    if (this_line == last_line)
         return;
-    }
 
-    current_line_set(lines[this_line], LINE_SIZE);
+    this_line = line_buffer_next(this_line);
+    line_buffer_load(this_line);
 }
 
 
@@ -317,11 +359,23 @@ void prompt_line_append(const char *s, unsigned n) {
     current_line_append(s, n);
 }
 
+const char *prompt_tag = "";
+
 void prompt_use_new_line() {
+    if (prompt_machine) {
+        prompt_pending = true;
+        print_str(prompt_tag);
+        return;
+    }
     if (prompt_active) {
         println();
         prompt_active = false;
     }
+    print_str(prompt_tag);
+}
+
+void prompt_set_tag(const char *tag) {
+    prompt_tag = tag;
 }
 
 bool use_fresh_line = true;
@@ -329,8 +383,10 @@ bool in_csi_seq = false;
 char last_char = 0;
 
 prompt_action prompt_handle_char(const char c);
+prompt_action prompt_machine_handle_input();
 
-prompt_action prompt_handle_input() {
+// takes over the output (on a fresh line if a line was executed)
+void prompt_show() {
 
     if (use_fresh_line) {
         use_fresh_line = false;
@@ -340,6 +396,14 @@ prompt_action prompt_handle_input() {
 
     if (!prompt_active)
         current_line_print();
+}
+
+prompt_action prompt_handle_input() {
+
+    if (prompt_machine)
+        return prompt_machine_handle_input();
+
+    prompt_show();
 
     while (has_available()) {
 
@@ -440,3 +504,75 @@ prompt_action prompt_handle_char(const char c) {
     return prompt_action_none;
 }
 
+
+prompt_action prompt_machine_handle_input() {
+
+    if (prompt_pending) {
+        // end the output that happened in between commands
+        prompt_pending = false;
+        println(PromptReplyEnd);
+    }
+
+    if (use_fresh_line) {
+        use_fresh_line = false;
+        current_line_clear();
+    }
+
+    while (has_available()) {
+
+        char c = get_char();
+
+        if (c == -1) {
+            // No data available
+            last_char = c;
+            return prompt_action_none;
+        }
+
+        bool crlf = c == '\n' && last_char == '\r';
+        last_char = c;
+
+        if (c == '\n' || c == '\r') {
+            if (crlf)
+                return prompt_action_none;
+            // every line is executed (and answered), even an empty one
+            use_fresh_line = true;
+            return prompt_action_execute;
+        }
+
+        // everything else is taken as is (no echo, no escape sequences)
+        current_line_insert(c);
+    }
+
+    return prompt_action_none;
+}
+
+void prompt_reply(bool ok) {
+    if (!prompt_machine) {
+        // the prompt ends the reply before other tasks print anything
+        prompt_show();
+        return;
+    }
+    prompt_pending = false;
+    println(ok ? PromptReplyOk : PromptReplyErr);
+}
+
+cli_param_bool prompt_machine_this = make_cli_param_bool(prompt_machine, false);
+// not part of the configuration, an import must not switch the mode
+cli_param prompt_machine_param = {
+    .name           = "machine",
+    .description    = prompt_machine_desc,
+    .pThis          = &prompt_machine_this,
+    .set            = cli_param_bool_set,
+    .reset          = cli_param_bool_reset,
+    .print          = cli_param_bool_print,
+    .next           = 0,
+    .save           = cli_param_no_save,
+};
+
+cli_module prompt_module = {
+    .name           = "prompt",
+    .description    = prompt_mod_desc,
+    .param          = &prompt_machine_param,
+    .cmd            = 0,
+    .next           = 0,
+};
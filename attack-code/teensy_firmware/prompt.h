@@ -18,6 +18,8 @@
 
 #include <stdint.h>
 
+#include "cli.h"
+
 enum prompt_action : uint8_t {
     prompt_action_none,
     prompt_action_execute,
@@ -51,4 +53,34 @@ void prompt_line_append(const char *s, unsigned n);
 // prompt_handle_input will also use a fresh line for the prompt.
 void prompt_use_new_line();
 
+// Sets a tag that is printed at the start of the fresh line of
+// prompt_use_new_line (e.g. the target the output belongs to).
+void prompt_set_tag(const char *tag);
+
+// Machine mode (for scripts): no echo, no history, no line editing and no
+// prompt. Every executed line is answered with a status line (see
+// prompt_reply) and output in between commands (e.g. the glitch results)
+// is ended with PromptReplyEnd.
+extern bool prompt_machine;
+
+#define PromptReplyOk   "OK"
+#define PromptReplyErr  "ERR"
+#define PromptReplyEnd  "END"
+
+// Ends the output of an executed line, with its status in machine mode and
+// with the prompt otherwise (so output of other tasks starts a new message).
+void prompt_reply(bool ok);
+
+#define prompt_mod_desc \
+    "The command prompt."
+
+#define prompt_machine_desc \
+    "Whether the prompt is in machine mode:\r\n" \
+    "  false -> echo, history and line editing (for terminals)\r\n" \
+    "  true  -> no echo, every command is answered with a status line\r\n" \
+    "           (" PromptReplyOk " or " PromptReplyErr "), output in between commands is\r\n" \
+    "           ended with " PromptReplyEnd
+
+extern cli_module prompt_module;
+
 #endif /* PROMPT_H */
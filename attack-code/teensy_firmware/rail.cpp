@@ -0,0 +1,271 @@
+// Copyright (C) 2021 Niklas Jacob
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "io.h"
+#include "teensy_adc.hpp"
+
+#include "rail.h"
+
+bool        rail_enabled        = DefaultRailEnabled;
+uint32_t    rail_pin            = DefaultRailPin;
+uint32_t    rail_scale          = DefaultRailScale;
+uint32_t    rail_threshold      = DefaultRailThreshold;
+uint32_t    rail_pre            = DefaultRailPre;
+uint32_t    rail_points         = DefaultRailPoints;
+
+// analog pins 14 (A0) to 27 (A13)
+const Pad::Hardware rail_pads[] = {
+    Pad14, Pad15, Pad16, Pad17, Pad18, Pad19, Pad20,
+    Pad21, Pad22, Pad23, Pad24, Pad25, Pad26, Pad27,
+};
+
+volatile uint16_t rail_buffer[RailBufferSize];
+Adc::Sampler rail_sampler(rail_buffer, RailBufferSize);
+
+bool        rail_running        = false;
+// measured when enabled, in picoseconds
+uint32_t    rail_sample_ps      = 0;
+
+bool        rail_captured       = false;
+unsigned    rail_start          = 0;
+unsigned    rail_end            = 0;
+// the length of the capture (the buffer positions don't tell if it wrapped)
+uint32_t    rail_start_cycles   = 0;
+uint32_t    rail_cycles         = 0;
+
+inline uint32_t rail_to_mv(uint16_t sample) {
+    return sample * rail_scale / Adc::MaxSample;
+}
+
+uint16_t rail_sample_of_mv(uint32_t mv) {
+    uint32_t sample = mv * Adc::MaxSample / rail_scale;
+    return sample > Adc::MaxSample ? Adc::MaxSample : sample;
+}
+
+bool rail_is_enabled() { return rail_running; }
+
+uint32_t rail_latest_mv() { return rail_to_mv(rail_sampler.latest()); }
+
+FASTRUN uint16_t rail_latest_sample() { return rail_sampler.latest(); }
+
+FASTRUN void rail_glitch_start() {
+    if (!rail_running) return;
+    rail_sampler.resume();
+    rail_start = rail_sampler.position();
+    rail_start_cycles = ARM_DWT_CYCCNT;
+}
+
+FASTRUN void rail_glitch_end() {
+    if (!rail_running) return;
+    rail_sampler.stop();
+    rail_cycles = ARM_DWT_CYCCNT - rail_start_cycles;
+    rail_end = rail_sampler.position();
+    rail_captured = true;
+}
+
+// lets the ring buffer fill halfway and times it with the cycle counter
+bool rail_measure_sample_period() {
+
+    constexpr unsigned count = RailBufferSize / 2;
+
+    unsigned start = rail_sampler.position(), n = 0;
+    uint32_t cycles = ARM_DWT_CYCCNT;
+    uint32_t timeout = rough_busy_wait_ms(10);
+
+    while (n < count && timeout--)
+        n = (rail_sampler.position() + RailBufferSize - start) % RailBufferSize;
+
+    cycles = ARM_DWT_CYCCNT - cycles;
+
+    if (n < count) return false;
+
+    rail_sample_ps = (uint64_t) cycles * 1000000 / (F_CPU_ACTUAL / 1000000) / n;
+    return true;
+}
+
+bool rail_setup() {
+
+    if (rail_running) {
+        rail_sampler.reset();
+        rail_running = false;
+        rail_captured = false;
+    }
+
+    if (!rail_enabled)
+        return true;
+
+    uint8_t channel = Adc::channel_of_pin(rail_pin);
+    if (channel == 0xff) {
+        println("Error: The pin has no analog input!");
+        return false;
+    }
+
+    if (!rail_sampler.setup(rail_pads[rail_pin - 14], channel)) {
+        println("Error: The ADC calibration failed!");
+        return false;
+    }
+
+    if (!rail_measure_sample_period()) {
+        rail_sampler.reset();
+        println("Error: The ADC doesn't convert!");
+        return false;
+    }
+
+    rail_running = true;
+    return true;
+}
+
+void rail_print_capture() {
+
+    if (!rail_captured) return;
+    rail_captured = false;
+
+    uint64_t samples = (uint64_t) rail_cycles * 1000000 / (F_CPU_ACTUAL / 1000000) / rail_sample_ps;
+    unsigned len = (rail_end + RailBufferSize - rail_start) % RailBufferSize + rail_pre;
+    if (samples + rail_pre > RailBufferSize) {
+        println("Warning: The rail capture wrapped, only its end is evaluated!");
+        len = RailBufferSize;
+    }
+    if (len > RailBufferSize)
+        len = RailBufferSize;
+    unsigned first = rail_end + RailBufferSize - len;
+
+    uint16_t threshold = rail_sample_of_mv(rail_threshold);
+    uint16_t min = Adc::MaxSample, s;
+    unsigned below = 0;
+
+    for (unsigned i = 0; i < len; i++) {
+        s = rail_sampler.at(first + i);
+        if (s < min) min = s;
+        if (s < threshold) below++;
+    }
+
+    print_str("Rail: min = ");
+    print_hex_int(rail_to_mv(min));
+    print_str(" mV, below = ");
+    print_hex_int((uint64_t) below * rail_sample_ps / 1000);
+    println(" ns");
+
+    unsigned points = rail_points < len ? rail_points : len;
+    if (points) {
+        unsigned per_point = len / points;
+
+        print_str("Rail: ");
+        print_hex_int(points);
+        print_str(" points every ");
+        print_hex_int((uint64_t) per_point * rail_sample_ps / 1000);
+        print_str(" ns (mV):");
+
+        for (unsigned p = 0; p < points; p++) {
+            min = Adc::MaxSample;
+            for (unsigned i = p * per_point; i < (p + 1) * per_point; i++) {
+                s = rail_sampler.at(first + i);
+                if (s < min) min = s;
+            }
+            print_char(' ');
+            print_hex_short(rail_to_mv(min));
+        }
+        println();
+    }
+
+    rail_sampler.resume();
+}
+
+
+/////////
+// CLI //
+/////////
+
+// changing these parameters restarts the sampling
+
+bool rail_bool_set(void * pThis, const char * value, unsigned n) {
+    return cli_param_bool_set(pThis, value, n) && rail_setup();
+}
+
+bool rail_bool_reset(void * pThis) {
+    return cli_param_bool_reset(pThis) && rail_setup();
+}
+
+bool rail_u32_set(void * pThis, const char * value, unsigned n) {
+    return cli_param_u32_set(pThis, value, n) && rail_setup();
+}
+
+bool rail_u32_reset(void * pThis) {
+    return cli_param_u32_reset(pThis) && rail_setup();
+}
+
+cli_param_bool rail_enabled_this    = make_cli_param_bool(rail_enabled, DefaultRailEnabled);
+
+cli_param_u32 rail_pin_this         = make_cli_param_u32(rail_pin,          DefaultRailPin,         14, 27);
+cli_param_u32 rail_scale_this       = make_cli_param_u32(rail_scale,        DefaultRailScale,       1,  0xffff);
+cli_param_u32 rail_threshold_this   = make_cli_param_u32(rail_threshold,    DefaultRailThreshold,   0,  0xffff);
+cli_param_u32 rail_pre_this         = make_cli_param_u32(rail_pre,          DefaultRailPre,         0,  RailBufferSize);
+cli_param_u32 rail_points_this      = make_cli_param_u32(rail_points,       DefaultRailPoints,      0,  RailMaxPoints);
+
+cli_param rail_points_param     = make_cli_param_u32_param("points",    rail_points_desc,       rail_points_this,       0);
+cli_param rail_pre_param        = make_cli_param_u32_param("pre",       rail_pre_desc,          rail_pre_this,          &rail_points_param);
+cli_param rail_threshold_param  = make_cli_param_u32_param("threshold", rail_threshold_desc,    rail_threshold_this,    &rail_pre_param);
+cli_param rail_scale_param      = make_cli_param_u32_param("scale",     rail_scale_desc,        rail_scale_this,        &rail_threshold_param);
+
+cli_param rail_pin_param = {
+    .name           = "pin",
+    .description    = rail_pin_desc,
+    .pThis          = &rail_pin_this,
+    .set            = rail_u32_set,
+    .reset          = rail_u32_reset,
+    .print          = cli_param_u32_print,
+    .next           = &rail_scale_param,
+};
+
+cli_param rail_enabled_param = {
+    .name           = "enabled",
+    .description    = rail_enabled_desc,
+    .pThis          = &rail_enabled_this,
+    .set            = rail_bool_set,
+    .reset          = rail_bool_reset,
+    .print          = cli_param_bool_print,
+    .next           = &rail_pin_param,
+};
+
+bool rail_print(void * pThis) {
+    if (!rail_running) {
+        println("Error: The rail isn't sampled (see \"help rail enabled\")!");
+        return false;
+    }
+    print_str("voltage = ");
+    print_hex_int(rail_latest_mv());
+    println(" mV");
+    print_str("sample period = ");
+    print_hex_int(rail_sample_ps);
+    println(" ps");
+    return true;
+}
+
+cli_command rail_print_cmd = {
+    .name           = "",
+    .description    = rail_cmd_desc,
+    .pThis          = 0,
+    .exec           = &rail_print,
+    .next           = 0,
+};
+
+cli_module rail_module = {
+    .name           = "rail",
+    .description    = rail_mod_desc,
+    .param          = &rail_enabled_param,
+    .cmd            = &rail_print_cmd,
+    .next           = 0,
+};
@@ -0,0 +1,83 @@
+// Copyright (C) 2021 Niklas Jacob
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef RAIL_H
+#define RAIL_H
+
+#include "hw.h"
+#include "cli.h"
+
+
+// ~12 ms at ~1.4 MSPS
+constexpr unsigned  RailBufferSize          = 16384;
+constexpr unsigned  RailMaxPoints           = 64;
+
+constexpr bool      DefaultRailEnabled      = false;
+// pins 22 (A8) and 23 (A9) are free in both hardware configurations
+constexpr uint32_t  DefaultRailPin          = 22;
+constexpr uint32_t  DefaultRailScale        = 3300;
+constexpr uint32_t  DefaultRailThreshold    = 800;
+constexpr uint32_t  DefaultRailPre          = 32;
+constexpr uint32_t  DefaultRailPoints       = 16;
+
+// called by glitch() around the glitch loop (the end on every exit path)
+void rail_glitch_start();
+void rail_glitch_end();
+
+// reports the rail during the last glitch (after the result)
+void rail_print_capture();
+
+bool rail_is_enabled();
+
+// the last converted sample in mV
+uint32_t rail_latest_mv();
+
+// for comparisons without conversions in time-critical loops
+uint16_t rail_latest_sample();
+uint16_t rail_sample_of_mv(uint32_t mv);
+
+
+#define rail_mod_desc \
+    "Samples a voltage rail of the target with the ADC while glitching.\r\n" \
+    "The samples from pre samples before the first glitch until the end\r\n" \
+    "of the last cooldown are evaluated after every glitch result:\r\n" \
+    "  - the minimum voltage (in mV)\r\n" \
+    "  - the time spent below the threshold (in ns)\r\n" \
+    "  - a waveform of points many values (the minimum of each part)\r\n" \
+    "Note: The rail is sampled at roughly 1.4 MSPS, connect it to the\r\n" \
+    "      pin through a divider if it may exceed 3.3 V."
+#define rail_cmd_desc \
+    "Prints the current voltage and the measured sample period."
+
+#define rail_enabled_desc \
+    "Whether the rail is sampled."
+#define rail_pin_desc \
+    "The analog pin the rail is connected to (14 to 27, 22 and 23 are\r\n" \
+    "free in both hardware configurations)."
+#define rail_scale_desc \
+    "The voltage (in mV) at the pin's maximum sample value (3.3 V\r\n" \
+    "times the divider ratio)."
+#define rail_threshold_desc \
+    "The voltage (in mV) below which the time is measured."
+#define rail_pre_desc \
+    "How many samples before the first glitch are evaluated."
+#define rail_points_desc \
+    "How many points of the waveform are printed (zero for none)."
+
+extern cli_module rail_module;
+
+
+#endif /* RAIL_H */
@@ -13,31 +13,63 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
+#include <core_pins.h>
+
 #include "hw.h"
 #include "prompt.h"
 #include "amd_cmds.h"
 
 #include "restart.h"
+#include "stats.h"
+#include "trace.h"
 
 uint8_t     restart_status      = DefaultRestartStatus;
 
 bool restart_is_off() { return restart_status == dut_off; }
 
+bool restart_is_running() { return restart_status == dut_running; }
+
 bool        disable_telemetry   = DefaultRestartDisableTelemetry;
 
 uint32_t    restart_wait_off    = DefaultRestartWaitOff;
 uint32_t    restart_wait_on     = DefaultRestartWaitOn ;
 uint32_t    restart_delay       = DefaultRestartDelay;
 uint32_t    restart_reset_len   = DefaultRestartResetLen;
-
-
-
+uint32_t    restart_holdoff     = DefaultRestartHoldoff;
+uint32_t    restart_tune_tries  = DefaultRestartTuneTries;
+uint32_t    restart_tune_timeout= DefaultRestartTuneTimeout;
+uint32_t    restart_tune_margin = DefaultRestartTuneMargin;
+bool        restart_recover     = DefaultRestartRecover;
+uint32_t    restart_recover_backoff     = DefaultRestartRecoverBackoff;
+uint32_t    restart_recover_max_backoff = DefaultRestartRecoverMaxBackoff;
+uint32_t    restart_recover_timeout     = DefaultRestartRecoverTimeout;
+uint32_t    restart_recover_alarm       = DefaultRestartRecoverAlarm;
+
+
+cli_param_u32 restart_tune_margin_this  = make_cli_param_u32(restart_tune_margin,   DefaultRestartTuneMargin,   0, 1000);
+cli_param_u32 restart_recover_alarm_this        = make_cli_param_u32(restart_recover_alarm,         DefaultRestartRecoverAlarm,         1, 0xffffffff);
+cli_param_u32 restart_recover_timeout_this      = make_cli_param_u32(restart_recover_timeout,       DefaultRestartRecoverTimeout,       1, 0xffffffff);
+cli_param_u32 restart_recover_max_backoff_this  = make_cli_param_u32(restart_recover_max_backoff,   DefaultRestartRecoverMaxBackoff,    0, 0xffffffff);
+cli_param_u32 restart_recover_backoff_this      = make_cli_param_u32(restart_recover_backoff,       DefaultRestartRecoverBackoff,       0, 0xffffffff);
+cli_param_bool restart_recover_this             = make_cli_param_bool(restart_recover, DefaultRestartRecover);
+cli_param_u32 restart_tune_timeout_this = make_cli_param_u32(restart_tune_timeout,  DefaultRestartTuneTimeout,  1, 0xffffffff);
+cli_param_u32 restart_tune_tries_this   = make_cli_param_u32(restart_tune_tries,    DefaultRestartTuneTries,    1, 0xffffffff);
+cli_param_u32 restart_holdoff_this      = make_cli_param_u32(restart_holdoff,   DefaultRestartHoldoff,  0, 0xffffffff);
 cli_param_u32 restart_reset_len_this    = make_cli_param_u32(restart_reset_len, DefaultRestartResetLen, 0, 0xffffffff);
 cli_param_u32 restart_delay_this        = make_cli_param_u32(restart_delay,     DefaultRestartDelay,    0, 0xffffffff);
 cli_param_u32 restart_wait_off_this     = make_cli_param_u32(restart_wait_off,  DefaultRestartWaitOff,  0, 0xffffffff);
 cli_param_u32 restart_wait_on_this      = make_cli_param_u32(restart_wait_on,   DefaultRestartWaitOn,   0, 0xffffffff);
 
-cli_param restart_reset_len_param       = make_cli_param_u32_param("reset_len", restart_reset_len_desc, restart_reset_len_this, 0);
+cli_param restart_recover_alarm_param       = make_cli_param_u32_param("recover_alarm",         restart_recover_alarm_desc,         restart_recover_alarm_this,         0);
+cli_param restart_recover_timeout_param     = make_cli_param_u32_param("recover_timeout",       restart_recover_timeout_desc,       restart_recover_timeout_this,       &restart_recover_alarm_param);
+cli_param restart_recover_max_backoff_param = make_cli_param_u32_param("recover_max_backoff",   restart_recover_max_backoff_desc,   restart_recover_max_backoff_this,   &restart_recover_timeout_param);
+cli_param restart_recover_backoff_param     = make_cli_param_u32_param("recover_backoff",       restart_recover_backoff_desc,       restart_recover_backoff_this,       &restart_recover_max_backoff_param);
+cli_param restart_recover_param             = make_cli_param_bool_param("recover",              restart_recover_desc,               restart_recover_this,               &restart_recover_backoff_param);
+cli_param restart_tune_margin_param     = make_cli_param_u32_param("tune_margin",   restart_tune_margin_desc,   restart_tune_margin_this,   &restart_recover_param);
+cli_param restart_tune_timeout_param    = make_cli_param_u32_param("tune_timeout",  restart_tune_timeout_desc,  restart_tune_timeout_this,  &restart_tune_margin_param);
+cli_param restart_tune_tries_param      = make_cli_param_u32_param("tune_tries",    restart_tune_tries_desc,    restart_tune_tries_this,    &restart_tune_timeout_param);
+cli_param restart_holdoff_param         = make_cli_param_u32_param("holdoff",   restart_holdoff_desc,   restart_holdoff_this,   &restart_tune_tries_param);
+cli_param restart_reset_len_param       = make_cli_param_u32_param("reset_len", restart_reset_len_desc, restart_reset_len_this, &restart_holdoff_param);
 cli_param restart_delay_param           = make_cli_param_u32_param("delay",     restart_delay_desc,     restart_delay_this,     &restart_reset_len_param);
 cli_param restart_wait_off_param        = make_cli_param_u32_param("wait_off",  restart_wait_off_desc,  restart_wait_off_this,  &restart_delay_param);
 cli_param restart_wait_on_param         = make_cli_param_u32_param("wait_on",   restart_wait_on_desc,   restart_wait_on_this,   &restart_wait_off_param);
@@ -59,6 +91,7 @@ cli_param restart_disable_telemetry_param = {
 bool restart_detect_set(void * pThis, const char *value, unsigned n);
 bool restart_detect_reset(void * pThis);
 bool restart_detect_print(void *pThis);
+bool restart_detect_save(void *pThis);
 
 cli_param restart_detect_param = {
     .name           = "detect",
@@ -68,26 +101,301 @@ cli_param restart_detect_param = {
     .reset          = restart_detect_reset,
     .print          = restart_detect_print,
     .next           = &restart_disable_telemetry_param,
+    .save           = restart_detect_save,
 };
 
 
-bool restart_reset(void *) {
-    println("Resetting target!");
+uint32_t    restart_last_reset  = 0;
+bool        restart_reset_requested = false;
+// whether a restart was detected after the last reset
+bool        restart_booted      = false;
 
-    uint32_t timeout = restart_reset_len;
+void restart_reset_target_for(uint32_t len) {
+    uint32_t timeout = len;
     hw.reset_pin.set_low();
+    trace_event(trace_reset, 1);
     BUSY_LOOP(reset, timeout);
     hw.reset_pin.set_high();
+    trace_event(trace_reset, 0);
+    restart_last_reset = millis();
+    // without restart detection the boot can't be seen, the reset counts
+    restart_booted = restart_status == restart_detection_off;
+}
+
+void restart_reset_target() {
+    restart_reset_target_for(restart_reset_len);
+}
+
+// recovery state
+uint32_t    restart_broken_in_row   = 0;
+uint32_t    restart_no_boots        = 0;
+bool        restart_recovering      = false;
+bool        restart_recover_reset_done = false;
+uint32_t    restart_recover_at      = 0;
+
+void restart_request_reset() {
+    // the recovery reset serves the request (unless the target booted
+    // already, then the recovery is just about to end)
+    if (restart_recovering && !(restart_recover_reset_done && restart_booted)) return;
+    restart_reset_requested = true;
+}
+
+uint32_t restart_backoff(uint32_t in_row) {
+    uint64_t backoff = restart_recover_backoff;
+    for (uint32_t i = 1; i < in_row && backoff && backoff < restart_recover_max_backoff; i++)
+        backoff <<= 1;
+    return backoff < restart_recover_max_backoff ? backoff : restart_recover_max_backoff;
+}
+
+void restart_schedule_recovery(uint32_t in_row) {
+    restart_recovering = true;
+    restart_recover_reset_done = false;
+    restart_recover_at = millis() + restart_backoff(in_row);
+}
+
+void restart_glitch_result(bool broken) {
+
+    if (!broken) {
+        restart_broken_in_row = 0;
+        return;
+    }
+
+    restart_broken_in_row++;
+    if (!restart_recover) return;
+
+    print_str("Recovering target (");
+    print_hex_int(restart_broken_in_row);
+    println(" broken in a row)!");
+    restart_reset_requested = false;
+    restart_no_boots = 0;
+    restart_schedule_recovery(restart_broken_in_row);
+}
+
+void restart_process_recovery() {
+
+    if (!restart_recover_reset_done) {
+        if ((int32_t) (millis() - restart_recover_at) < 0) return;
+        restart_recover_reset_done = true;
+        prompt_use_new_line();
+        println("Resetting target!");
+        restart_reset_target();
+        return;
+    }
+
+    if (restart_booted) {
+        restart_recovering = false;
+        restart_no_boots = 0;
+        return;
+    }
+
+    if (millis() - restart_last_reset <= restart_recover_timeout) return;
+
+    restart_no_boots++;
+    if (restart_no_boots >= restart_recover_alarm) {
+        restart_recovering = false;
+        prompt_use_new_line();
+        print_str("Alarm: The target didn't boot after ");
+        print_hex_int(restart_no_boots);
+        println(" resets!");
+        restart_no_boots = 0;
+        return;
+    }
+
+    restart_schedule_recovery(restart_broken_in_row + restart_no_boots);
+}
+
+// tuning state
+enum restart_tune_phase : uint8_t {
+    restart_tune_off,
+    restart_tune_reset_len,
+    restart_tune_holdoff,
+};
+
+uint8_t     restart_tune_phase  = restart_tune_off;
+// the value is searched in ]lo, hi], hi gave clean boots
+uint32_t    restart_tune_lo     = 0;
+uint32_t    restart_tune_hi     = 0;
+uint32_t    restart_tune_value  = 0;
+bool        restart_tune_verified = false;
+uint32_t    restart_tune_boots  = 0;
+bool        restart_tune_booting= false;
+bool        restart_tune_was_off= false;
+
+hw_target_var restart_tune_was_off_var      = make_hw_target_var(restart_tune_was_off,      0);
+hw_target_var restart_tune_booting_var      = make_hw_target_var(restart_tune_booting,      &restart_tune_was_off_var);
+hw_target_var restart_tune_boots_var        = make_hw_target_var(restart_tune_boots,        &restart_tune_booting_var);
+hw_target_var restart_tune_verified_var     = make_hw_target_var(restart_tune_verified,     &restart_tune_boots_var);
+hw_target_var restart_tune_value_var        = make_hw_target_var(restart_tune_value,        &restart_tune_verified_var);
+hw_target_var restart_tune_hi_var           = make_hw_target_var(restart_tune_hi,           &restart_tune_value_var);
+hw_target_var restart_tune_lo_var           = make_hw_target_var(restart_tune_lo,           &restart_tune_hi_var);
+hw_target_var restart_tune_phase_var        = make_hw_target_var(restart_tune_phase,        &restart_tune_lo_var);
+hw_target_var restart_recover_at_var        = make_hw_target_var(restart_recover_at,        &restart_tune_phase_var);
+hw_target_var restart_recover_reset_done_var= make_hw_target_var(restart_recover_reset_done,&restart_recover_at_var);
+hw_target_var restart_recovering_var        = make_hw_target_var(restart_recovering,        &restart_recover_reset_done_var);
+hw_target_var restart_no_boots_var          = make_hw_target_var(restart_no_boots,          &restart_recovering_var);
+hw_target_var restart_broken_in_row_var     = make_hw_target_var(restart_broken_in_row,     &restart_no_boots_var);
+hw_target_var restart_booted_var            = make_hw_target_var(restart_booted,            &restart_broken_in_row_var);
+hw_target_var restart_reset_requested_var   = make_hw_target_var(restart_reset_requested,   &restart_booted_var);
+hw_target_var restart_last_reset_var        = make_hw_target_var(restart_last_reset,        &restart_reset_requested_var);
+hw_target_var restart_target_vars           = make_hw_target_var(restart_status,            &restart_last_reset_var);
+
+void restart_tune_start_phase(uint8_t phase, uint32_t value) {
+    restart_tune_phase = phase;
+    restart_tune_lo = 0;
+    restart_tune_hi = value;
+    restart_tune_value = value;
+    restart_tune_verified = false;
+    restart_tune_boots = 0;
+    restart_tune_booting = false;
+}
+
+bool restart_tune(void *) {
+    if (restart_status == restart_detection_off) {
+        println("Error: Restart detection is off!");
+        return false;
+    }
+    println("Tuning started!");
+    restart_reset_requested = false;
+    restart_tune_start_phase(restart_tune_reset_len, restart_reset_len);
+    return true;
+}
+
+// a value is decided after tune_tries clean boots or the first unclean one
+void restart_tune_decide(bool clean) {
+
+    prompt_use_new_line();
+    if (restart_tune_phase == restart_tune_reset_len)
+        print_str("reset_len ");
+    else
+        print_str("holdoff   ");
+    print_hex_int(restart_tune_value);
+    print_str(": ");
+    print_hex_int(restart_tune_boots);
+    println(clean ? " clean boots" : " clean boots, then a broken one");
+
+    if (!restart_tune_verified && !clean) {
+        restart_tune_phase = restart_tune_off;
+        println("Tuning failed!");
+        println("Error: The current value doesn't give clean boots!");
+        return;
+    }
+    restart_tune_verified = true;
+
+    if (clean)
+        restart_tune_hi = restart_tune_value;
+    else
+        restart_tune_lo = restart_tune_value;
 
+    restart_tune_boots = 0;
+
+    if (restart_tune_hi - restart_tune_lo > restart_tune_hi / 16 + 1) {
+        restart_tune_value = restart_tune_lo + (restart_tune_hi - restart_tune_lo) / 2;
+        return;
+    }
+
+    uint64_t value = restart_tune_hi + (uint64_t) restart_tune_hi * restart_tune_margin / 100;
+    if (value > 0xffffffff) value = 0xffffffff;
+
+    if (restart_tune_phase == restart_tune_reset_len) {
+        restart_reset_len = value;
+        print_hex_param("restart reset_len", restart_reset_len, int);
+        restart_tune_start_phase(restart_tune_holdoff, restart_holdoff);
+        return;
+    }
+
+    restart_holdoff = value;
+    print_hex_param("restart holdoff", restart_holdoff, int);
+    restart_tune_phase = restart_tune_off;
+    println("Tuning done!");
+}
+
+// the booted target accesses its flash, chip-select goes low within ~1 ms
+bool restart_tune_cs_active() {
+    uint32_t timeout = rough_busy_wait_us(1000);
+    BUSY_LOOP_WHILE_PIN_HIGH(tune_cs, timeout, hw.cs_pin);
+    return timeout;
+}
+
+void restart_process_tune() {
+
+    uint32_t since_reset = millis() - restart_last_reset;
+
+    if (!restart_tune_booting) {
+
+        uint32_t holdoff = restart_holdoff, len = restart_reset_len;
+        if (restart_tune_phase == restart_tune_holdoff)
+            holdoff = restart_tune_value;
+        else
+            len = restart_tune_value;
+
+        if (since_reset < holdoff) return;
+
+        restart_tune_booting = true;
+        restart_tune_was_off = false;
+        restart_reset_target_for(len);
+        return;
+    }
+
+    if (restart_is_off())
+        restart_tune_was_off = true;
+
+    bool clean = restart_tune_was_off && restart_is_running()
+        && restart_tune_cs_active();
+
+    if (!clean && since_reset <= restart_tune_timeout) return;
+
+    restart_tune_booting = false;
+    if (clean)
+        restart_tune_boots++;
+
+    if (clean && restart_tune_boots < restart_tune_tries) return;
+
+    restart_tune_decide(clean);
+}
+
+void restart_process() {
+
+    if (restart_tune_phase != restart_tune_off) {
+        restart_process_tune();
+        return;
+    }
+
+    if (restart_recovering) {
+        restart_process_recovery();
+        return;
+    }
+
+    if (!restart_reset_requested) return;
+    if (millis() - restart_last_reset < restart_holdoff) return;
+
+    restart_reset_requested = false;
+    prompt_use_new_line();
+    println("Resetting target!");
+    restart_reset_target();
+}
+
+bool restart_reset(void *) {
+    println("Resetting target!");
+    // serves a pending recovery (which then waits for the boot)
+    restart_recover_reset_done = true;
+    restart_reset_target();
     return true;
 }
 
+cli_command restart_tune_cmd = {
+    .name           = "tune",
+    .description    = restart_tune_cmd_desc,
+    .pThis          = 0,
+    .exec           = &restart_tune,
+    .next           = 0,
+};
+
 cli_command restart_reset_cmd = {
     .name           = "reset",
     .description    = restart_reset_cmd_desc,
     .pThis          = 0,
     .exec           = &restart_reset,
-    .next           = 0,
+    .next           = &restart_tune_cmd,
 };
 
 
@@ -133,6 +441,7 @@ uint8_t restart_update_status() {
         println("Target is now offline!");
 
         restart_status = dut_off;
+        trace_event(trace_target, dut_off);
         return dut_off;
     }
 
@@ -148,6 +457,8 @@ uint8_t restart_update_status() {
         prompt_use_new_line();
         println("Restart detected!");
         restart_status = dut_running;
+        trace_event(trace_target, dut_running);
+        restart_booted = true;
 
         // wait delay
         hw_trigger_restart_set_high();
@@ -169,7 +480,8 @@ uint8_t restart_update_status() {
     return restart_status;
 }
 
-void wait_for_free_bus() {
+template <class PINS>
+FASTRUN void wait_for_free_bus_on() {
 
 /*
 
@@ -185,6 +497,8 @@ SCL   -------+ +-+ +-+  //-+ +-----//-----+ +-+  //-+ +-+ +------
 */
 
 
+    typename PINS::scl_in_pin scl_in_pin;
+
     uint32_t timeout;
     uint32_t tries;
     
@@ -194,7 +508,7 @@ SCL   -------+ +-+ +-+  //-+ +-----//-----+ +-+  //-+ +-+ +------
     tries = rough_busy_wait_us(70);
     do {
         timeout = rough_busy_wait_us_f(.1);
-        BUSY_LOOP_WHILE_PIN_LOW(wait_tele, timeout, hw.scl_in_pin);
+        BUSY_LOOP_WHILE_PIN_LOW(wait_tele, timeout, scl_in_pin);
     } while (tries-- && timeout);
 
     // wait for free bus (scl high for at least 1 us)
@@ -203,12 +517,17 @@ SCL   -------+ +-+ +-+  //-+ +-----//-----+ +-+  //-+ +-+ +------
     tries = rough_busy_wait_us(70);
     do {
         timeout = rough_busy_wait_us(1);
-        BUSY_LOOP_WHILE_PIN_HIGH(wait_free, timeout, hw.scl_in_pin);
+        BUSY_LOOP_WHILE_PIN_HIGH(wait_free, timeout, scl_in_pin);
     } while (tries-- && timeout);
 }
 
+void wait_for_free_bus() {
+    HW_PINS_CALL(wait_for_free_bus_on);
+}
+
 bool restart() {
     bool result = true;
+    uint32_t start = ARM_DWT_CYCCNT;
 
     hw_trigger_restart_set_high();
 
@@ -237,6 +556,7 @@ bool restart() {
 
     hw_trigger_restart_set_low();
 
+    stats_record(stats_restart, ARM_DWT_CYCCNT - start);
     return result;
 }
 
@@ -292,6 +612,7 @@ bool restart_detect_set(void * pThis, const char *value, unsigned n) {
         || str_cmp(value, n, "0", sizeof("0")) == 0
     ) {
         restart_status = restart_detection_off;
+        restart_booted = true;
         return true;
     }
     println("Error: Couldn't parse value, use yes/no, true/false, on/off or 1/0!");
@@ -303,6 +624,11 @@ bool restart_detect_reset(void * pThis) {
     return true;
 }
 
+bool restart_detect_save(void * pThis) {
+    print_str(restart_status == restart_detection_off ? "off" : "on");
+    return true;
+}
+
 bool restart_detect_print(void * pThis) {
     switch (restart_status) {
         case restart_detection_off:
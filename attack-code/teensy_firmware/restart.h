@@ -16,6 +16,7 @@
 #ifndef RESTART_H
 #define RESTART_H
 
+#include "hw.h"
 #include "cli.h"
 
 
@@ -56,6 +57,24 @@ constexpr uint32_t  DefaultRestartDelay             = rough_busy_wait_ms(  2);
 
 constexpr uint32_t  DefaultRestartResetLen          = rough_busy_wait_ms( 80);
 
+constexpr uint32_t  DefaultRestartHoldoff           = 3000; // ms
+
+constexpr uint32_t  DefaultRestartTuneTries         = 3;
+
+constexpr uint32_t  DefaultRestartTuneTimeout       = 1000; // ms
+
+constexpr uint32_t  DefaultRestartTuneMargin        = 25;   // percent
+
+constexpr bool      DefaultRestartRecover           = false;
+
+constexpr uint32_t  DefaultRestartRecoverBackoff    = 100;  // ms
+
+constexpr uint32_t  DefaultRestartRecoverMaxBackoff = 5000; // ms
+
+constexpr uint32_t  DefaultRestartRecoverTimeout    = 1000; // ms
+
+constexpr uint32_t  DefaultRestartRecoverAlarm      = 3;
+
 #define restart_mod_desc \
     "This module controls the restart detecting and triggering."
 
@@ -67,6 +86,13 @@ constexpr uint32_t  DefaultRestartResetLen          = rough_busy_wait_ms( 80);
 #define restart_reset_cmd_desc \
     "Restarts the device under test by pulling the reset line low."
 
+#define restart_tune_cmd_desc \
+    "Searches the shortest reset_len and then the shortest holdoff that\r\n" \
+    "still give tune_tries clean boots in a row (the target goes offline\r\n" \
+    "and pulses chip-select within tune_timeout ms after the reset).\r\n" \
+    "Both are set to the found value plus tune_margin percent.\r\n" \
+    "Note: The current values have to give clean boots."
+
 #define restart_detect_desc \
     "Whether restart detection is enabled."
 #define restart_disable_telemetry_desc \
@@ -86,6 +112,30 @@ constexpr uint32_t  DefaultRestartResetLen          = rough_busy_wait_ms( 80);
 #define restart_reset_len_desc \
     "The reset line will be pulled low for this many busy loop\r\n" \
     "cycles when the \"restart reset\" command is issued."
+#define restart_holdoff_desc \
+    "How many ms have to pass after a reset before the firmware resets\r\n" \
+    "the target on its own (see \"attack reset\")."
+#define restart_recover_desc \
+    "Whether the target is reset right after a glitch broke it. The\r\n" \
+    "reset is repeated (after the backoff) until a restart is detected,\r\n" \
+    "\"restart reset\" and \"attack reset\" aren't needed for it."
+#define restart_recover_backoff_desc \
+    "How many ms are waited before the recovery reset, doubled for\r\n" \
+    "every further broken result or missing boot in a row."
+#define restart_recover_max_backoff_desc \
+    "The longest backoff in ms."
+#define restart_recover_timeout_desc \
+    "How many ms after a recovery reset a restart has to be detected."
+#define restart_recover_alarm_desc \
+    "After how many recovery resets in a row without a restart the\r\n" \
+    "alarm is raised and the recovery stops."
+#define restart_tune_tries_desc \
+    "How many clean boots in a row \"restart tune\" needs per value."
+#define restart_tune_timeout_desc \
+    "How many ms after the reset a boot has to be detected by\r\n" \
+    "\"restart tune\"."
+#define restart_tune_margin_desc \
+    "How many percent \"restart tune\" adds to the found values."
 
 uint8_t restart_update_status();
 
@@ -93,6 +143,24 @@ bool restart();
 
 bool restart_is_off();
 
+bool restart_is_running();
+
+// pulls the reset line low for reset_len busy loop cycles
+void restart_reset_target();
+
+// resets the target as soon as holdoff ms have passed since the last reset
+void restart_request_reset();
+
+// carries out requested resets, recoveries and the tuning
+void restart_process();
+
+// called with every glitch result, schedules a recovery reset after a
+// broken one (if recover is set)
+void restart_glitch_result(bool broken);
+
+// the per-target state (see hw_target_vars_append)
+extern hw_target_var restart_target_vars;
+
 extern cli_module restart_module;
 
 #endif /* RESTART_H */
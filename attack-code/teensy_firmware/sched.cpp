@@ -0,0 +1,151 @@
+// Copyright (C) 2021 Niklas Jacob
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include <core_pins.h>
+
+#include "io.h"
+
+#include "sched.h"
+
+sched_task *sched_tasks = 0;
+// the low task to run next
+sched_task *sched_next_low = 0;
+
+// every target takes its own turns through the low tasks
+hw_target_var sched_target_vars = make_hw_target_var(sched_next_low, 0);
+
+void sched_tasks_append(sched_task &task) {
+    if (!sched_tasks) {
+        sched_tasks = &task;
+        return;
+    }
+    sched_task *last = sched_tasks;
+    while (last->next)
+        last = last->next;
+    last->next = &task;
+}
+
+bool sched_is_due(const sched_task &task) {
+    return task.period == 0 || task.calls == 0
+        || millis() - task.last_run >= task.period;
+}
+
+void sched_run_task(sched_task &task) {
+    uint32_t start = ARM_DWT_CYCCNT;
+    task.run();
+    uint32_t cycles = ARM_DWT_CYCCNT - start;
+
+    task.calls++;
+    task.cycles += cycles;
+    if (cycles > task.max_cycles)
+        task.max_cycles = cycles;
+    if (task.period)
+        task.last_run = millis();
+}
+
+void sched_run_high() {
+    for (sched_task *task = sched_tasks; task; task = task->next)
+        if (task->priority == sched_high && sched_is_due(*task))
+            sched_run_task(*task);
+}
+
+void sched_run_low() {
+    // at most one full turn to find a due task
+    sched_task *task = sched_next_low;
+    for (unsigned n = 0; n < 2; ) {
+        if (!task) {
+            task = sched_tasks;
+            n++;
+            continue;
+        }
+        if (task->priority == sched_low && sched_is_due(*task)) {
+            sched_next_low = task->next;
+            sched_run_task(*task);
+            return;
+        }
+        task = task->next;
+    }
+}
+
+bool sched_show(void *) {
+
+    uint32_t max_low = 0;
+    uint64_t max_high = 0;
+
+    println("task       | prio | calls      | avg cycles | max cycles");
+    println("-----------|------|------------|------------|-----------");
+    for (sched_task *task = sched_tasks; task; task = task->next) {
+        print_str(task->name);
+        for (unsigned i = str_len(task->name, 10); i < 10; i++)
+            print_str(" ");
+        print_str(task->priority == sched_high ? " | high | " : " | low  | ");
+        print_hex_int(task->calls);
+        print_str(" | ");
+        print_hex_int(task->calls ? task->cycles / task->calls : 0);
+        print_str(" | ");
+        print_hex_int(task->max_cycles);
+        println();
+
+        if (task->priority == sched_high)
+            max_high += task->max_cycles;
+        else if (task->max_cycles > max_low)
+            max_low = task->max_cycles;
+    }
+
+    // a trigger is handled at the latest after the longest low task
+    // and a full round of high tasks (a round per target)
+    uint64_t bound = (max_low + max_high) * hw_targets;
+    print_str("high task delay <= ");
+    print_hex_int(bound > 0xffffffff ? 0xffffffff : bound);
+    print_str(" cycles (");
+    print_hex_int(bound * 1000000 / F_CPU_ACTUAL);
+    println(" us)");
+    return true;
+}
+
+bool sched_clear(void *) {
+    for (sched_task *task = sched_tasks; task; task = task->next) {
+        task->calls = 0;
+        task->cycles = 0;
+        task->max_cycles = 0;
+    }
+    println("Runtime counters cleared!");
+    return true;
+}
+
+cli_command sched_clear_cmd = {
+    .name           = "clear",
+    .description    = sched_clear_cmd_desc,
+    .pThis          = 0,
+    .exec           = &sched_clear,
+    .next           = 0,
+};
+
+cli_command sched_cmd = {
+    .name           = "",
+    .description    = sched_cmd_desc,
+    .pThis          = 0,
+    .exec           = &sched_show,
+    .next           = &sched_clear_cmd,
+};
+
+cli_module sched_module = {
+    .name           = "sched",
+    .description    = sched_mod_desc,
+    .param          = 0,
+    .cmd            = &sched_cmd,
+    .next           = 0,
+};
@@ -0,0 +1,97 @@
+// Copyright (C) 2021 Niklas Jacob
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef SCHED_H
+#define SCHED_H
+
+#include "hw.h"
+#include "cli.h"
+
+
+/*
+
+Run-to-completion scheduler of the main loop:
+
+  round: all high tasks -> next low task -> all high tasks -> next low task ...
+
+The high tasks (trigger handling) run in every round, the low tasks
+(prompt, housekeeping) take turns, only one of them per round. So the
+high tasks are delayed by at most the longest run of a single low task.
+With "hw config both" the targets take turns, a round each.
+
+*/
+
+enum sched_priority : uint8_t {
+    sched_high,
+    sched_low,
+};
+
+typedef void (*sched_fn) ();
+
+typedef struct sched_task {
+    const char  *name;
+    sched_fn    run;
+    uint8_t     priority;
+    // the task is skipped until period ms have passed since its last run
+    uint32_t    period;
+
+    // runtime counters (cpu cycles)
+    uint32_t    calls;
+    uint64_t    cycles;
+    uint32_t    max_cycles;
+    uint32_t    last_run;
+
+    struct sched_task *next;
+} sched_task;
+
+#define make_sched_task(NAME, RUN, PRIORITY, PERIOD) \
+{                           \
+    .name       = NAME,     \
+    .run        = RUN,      \
+    .priority   = PRIORITY, \
+    .period     = PERIOD,   \
+    .calls      = 0,        \
+    .cycles     = 0,        \
+    .max_cycles = 0,        \
+    .last_run   = 0,        \
+    .next       = 0,        \
+}
+
+void sched_tasks_append(sched_task &task);
+
+// runs all due high tasks
+void sched_run_high();
+
+// runs the next due low task
+void sched_run_low();
+
+// the per-target state (see hw_target_vars_append)
+extern hw_target_var sched_target_vars;
+
+
+#define sched_mod_desc \
+    "Runs the tasks of the main loop: the high priority tasks in every\r\n" \
+    "round and one low priority task per round."
+#define sched_cmd_desc \
+    "Prints the runtime counters of the tasks (in cpu cycles) and the\r\n" \
+    "longest delay of the high priority tasks seen so far."
+#define sched_clear_cmd_desc \
+    "Clears the runtime counters."
+
+extern cli_module sched_module;
+
+
+#endif /* SCHED_H */
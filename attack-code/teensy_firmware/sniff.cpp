@@ -0,0 +1,88 @@
+// Copyright (C) 2021 Niklas Jacob
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "sniff.h"
+#include "trace.h"
+
+// waits until svc is at the level given, returns false on timeout
+static inline bool sniff_wait_svc(bool high, uint32_t &timeout) {
+    while (hw.scl_in_pin.get() != high)
+        if (timeout-- == 0) return false;
+    return true;
+}
+
+FASTRUN int sniff_svi2_packet(uint32_t &wire, uint8_t &nacks, uint32_t &timeout) {
+
+    wire = 0;
+    nacks = 0;
+
+    // Wait for a start condition (svd falls while svc is high)
+    bool sda = hw.sda_in_pin.get(), sda_prev;
+    while (true) {
+        if (timeout-- == 0) return -1;
+        sda_prev = sda;
+        sda = hw.sda_in_pin.get();
+        if (sda_prev && !sda && hw.scl_in_pin.get())
+            break;
+    }
+
+    // Sample svd on every rising edge of svc
+    for (unsigned i = 0; i < Svi2PacketBits; i++) {
+
+        if (!sniff_wait_svc(false, timeout)) return -1;
+        if (!sniff_wait_svc(true, timeout)) return -1;
+
+        sda = hw.sda_in_pin.get();
+
+        // every ninth bit is the ack bit (active-low)
+        if (i % 9 == 8) {
+            nacks = (nacks << 1) | sda;
+            continue;
+        }
+
+        wire = (wire << 1) | sda;
+
+        // a start condition would change svd while svc stays high
+        if (i % 9 == 0) {
+            while (hw.scl_in_pin.get()) {
+                if (hw.sda_in_pin.get() != sda) return -2;
+                if (timeout-- == 0) return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+FASTRUN int sniff_send_verified(AmdSvi2::CommandRaw raw, bool &verified) {
+    uint32_t wire = 0, timeout = SniffLoopbackTimeout;
+    uint8_t nacks = 0;
+
+    verified = false;
+
+    trace_event(trace_packet, raw.to_wire());
+    int rc = twi_master.start_u16(raw.address, raw.data, twi_timeout);
+    if (rc >= 0) {
+        int sniffed = sniff_svi2_packet(wire, nacks, timeout);
+        rc = twi_master.finish(twi_timeout);
+        verified = sniffed == 0 && wire == raw.to_wire() && nacks == 0;
+    }
+    trace_event(trace_packet, TraceNone);
+
+    if (rc < 0)
+        trace_event(trace_error, -rc);
+    return rc;
+}
@@ -0,0 +1,47 @@
+// Copyright (C) 2021 Niklas Jacob
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef SNIFF_H
+#define SNIFF_H
+
+#include "hw.h"
+#include "amd_svi2.hpp"
+
+// Number of bits in a svi2 packet (three bytes, each followed by an ack bit)
+constexpr unsigned Svi2PacketBits = 27;
+
+// Waits for the next svi2 packet on the svc and svd input pins and records
+// it by polling the pins (the twi modules are busy injecting packets).
+//
+// wire:    the three bytes in bus order (address byte in bits 23..16),
+//          compare with CommandRaw::to_wire()
+// nacks:   which bytes weren't acknowledged (bit 2 is the address byte)
+// timeout: polling iterations left, decremented while waiting
+//
+// Returns zero on success or negative error codes:
+//  -1: timeout
+//  -2: the packet was cut short by another start condition
+int sniff_svi2_packet(uint32_t &wire, uint8_t &nacks, uint32_t &timeout);
+
+// polling iterations to wait for a packet that is being sent
+constexpr uint32_t SniffLoopbackTimeout = 100000;
+
+// Sends the packet (like CommandRaw::send) and reads it back on the svc
+// and svd input pins while it is on the bus. verified is set if it was
+// seen unchanged and all bytes were acknowledged.
+int sniff_send_verified(AmdSvi2::CommandRaw raw, bool &verified);
+
+#endif /* SNIFF_H */
@@ -0,0 +1,126 @@
+// Copyright (C) 2021 Niklas Jacob
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "io.h"
+#include "histogram.h"
+
+#include "stats.h"
+
+bool        stats_stream        = DefaultStatsStream;
+
+const char * const stats_phase_names[StatsPhases] = {
+    "wait",
+    "delay",
+    "latency",
+    "send",
+    "dwell",
+    "restore",
+    "ping",
+    "restart",
+};
+
+histogram   stats_histograms[StatsPhases];
+uint32_t    stats_max[StatsPhases];
+// the cycles of the last attempt (valid if set)
+uint32_t    stats_last[StatsPhases];
+bool        stats_last_set[StatsPhases];
+
+FASTRUN void stats_record(uint8_t phase, uint32_t cycles) {
+    stats_histograms[phase].add(cycles);
+    if (cycles > stats_max[phase])
+        stats_max[phase] = cycles;
+    stats_last[phase] = cycles;
+    stats_last_set[phase] = true;
+}
+
+void stats_print_last() {
+
+    if (stats_stream) {
+        print_str("Stats:");
+        for (unsigned i = 0; i < StatsPhases; i++) {
+            if (!stats_last_set[i]) continue;
+            print_str(" ");
+            print_str(stats_phase_names[i]);
+            print_str("=");
+            print_hex_int(stats_last[i]);
+        }
+        println();
+    }
+
+    for (unsigned i = 0; i < StatsPhases; i++)
+        stats_last_set[i] = false;
+}
+
+bool stats_show(void *) {
+    println("phase   | samples    | p50        | p90        | p99        | max");
+    println("--------|------------|------------|------------|------------|-----------");
+    for (unsigned i = 0; i < StatsPhases; i++) {
+        const histogram &h = stats_histograms[i];
+        print_str(stats_phase_names[i]);
+        for (unsigned j = str_len(stats_phase_names[i]); j < 7; j++)
+            print_str(" ");
+        print_str(" | ");
+        print_hex_int(h.total);
+        print_str(" | ");
+        print_hex_int(h.percentile(500));
+        print_str(" | ");
+        print_hex_int(h.percentile(900));
+        print_str(" | ");
+        print_hex_int(h.percentile(990));
+        print_str(" | ");
+        print_hex_int(stats_max[i]);
+        println();
+    }
+    println("Note: The values are cpu cycles, the percentiles are rounded up by <= 1/8.");
+    return true;
+}
+
+bool stats_clear(void *) {
+    for (unsigned i = 0; i < StatsPhases; i++) {
+        stats_histograms[i].clear();
+        stats_max[i] = 0;
+        stats_last_set[i] = false;
+    }
+    println("Stats cleared!");
+    return true;
+}
+
+cli_param_bool stats_stream_this = make_cli_param_bool(stats_stream, DefaultStatsStream);
+cli_param stats_stream_param = make_cli_param_bool_param("stream", stats_stream_desc, stats_stream_this, 0);
+
+cli_command stats_clear_cmd = {
+    .name           = "clear",
+    .description    = stats_clear_cmd_desc,
+    .pThis          = 0,
+    .exec           = &stats_clear,
+    .next           = 0,
+};
+
+cli_command stats_cmd = {
+    .name           = "",
+    .description    = stats_cmd_desc,
+    .pThis          = 0,
+    .exec           = &stats_show,
+    .next           = &stats_clear_cmd,
+};
+
+cli_module stats_module = {
+    .name           = "stats",
+    .description    = stats_mod_desc,
+    .param          = &stats_stream_param,
+    .cmd            = &stats_cmd,
+    .next           = 0,
+};
@@ -0,0 +1,69 @@
+// Copyright (C) 2021 Niklas Jacob
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef STATS_H
+#define STATS_H
+
+#include "hw.h"
+#include "cli.h"
+
+
+enum stats_phase : uint8_t {
+    stats_wait,     // attack: waiting for the trigger (waits / addr)
+    stats_delay,    // glitch: the delay busy loop
+    stats_latency,  // glitch: end of the delay until the glitch command was sent
+    stats_send,     // glitch: sending the glitch command
+    stats_dwell,    // glitch: the duration (or rail) loop
+    stats_restore,  // glitch: sending the default vid commands
+    stats_ping,     // glitch: end of the glitch until the ping
+    stats_restart,  // restart: setting the default vids after a restart
+    StatsPhases,
+};
+
+constexpr bool DefaultStatsStream = false;
+
+// Records the cpu cycles a phase took. Cheap, but the time-critical code
+// should take the time stamps (ARM_DWT_CYCCNT) and record them afterwards.
+void stats_record(uint8_t phase, uint32_t cycles);
+
+// called after every glitch result
+void stats_print_last();
+
+
+#define stats_mod_desc \
+    "Measures how many cpu cycles the phases of attacks, glitches and\r\n" \
+    "restarts take (with the cycle counter):\r\n" \
+    "  wait    -> waiting for the trigger of an attack\r\n" \
+    "  delay   -> the glitch delay\r\n" \
+    "  latency -> from the end of the delay until the glitch command was sent\r\n" \
+    "  send    -> sending the glitch command\r\n" \
+    "  dwell   -> the glitch duration\r\n" \
+    "  restore -> sending the default vid commands\r\n" \
+    "  ping    -> from the end of the glitch until the ping\r\n" \
+    "  restart -> setting the default vids after a restart"
+#define stats_cmd_desc \
+    "Prints the percentiles of the recorded cycles."
+#define stats_clear_cmd_desc \
+    "Clears the recorded cycles."
+
+#define stats_stream_desc \
+    "Whether the cycles of the last attempt are printed after every\r\n" \
+    "glitch result."
+
+extern cli_module stats_module;
+
+
+#endif /* STATS_H */
@@ -0,0 +1,122 @@
+// Copyright (C) 2021 Niklas Jacob
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef TEENSY_ADC_HPP
+#define TEENSY_ADC_HPP
+
+#include <imxrt.h>
+#include <DMAChannel.h>
+#include "teensy_pins.hpp"
+
+/*
+  [1]:  i.MX RT1060 Processor ReferenceManual
+        https://www.pjrc.com/teensy/IMXRT1060RM_rev2.pdf
+*/
+
+namespace Teensy {
+namespace Adc {
+
+// ADC1 input channel of the teensy pins 14 (A0) to 27 (A13)
+// (see [1] chapter 10 and https://www.pjrc.com/store/teensy40.html#tech)
+constexpr uint8_t Channels_14_27[] = {
+    7, 8, 12, 11, 6, 5, 15, 0, 13, 14, 1, 2, 3, 4,
+};
+
+constexpr uint8_t channel_of_pin(uint8_t pin) {
+    return (14 <= pin && pin <= 27) ? Channels_14_27[pin - 14] : 0xff;
+}
+
+// 10 bit samples
+constexpr uint16_t MaxSample = (1 << 10) - 1;
+
+// Converts one analog input of ADC1 continuously, a DMA channel copies
+// every result into a ring buffer. Capturing a waveform thus doesn't
+// cost any cpu time, the buffer only has to be read afterwards.
+struct Sampler {
+    volatile uint16_t   *buffer;
+    unsigned            size;       // in samples
+    DMAChannel          dma;
+
+    Sampler(volatile uint16_t *buffer, unsigned size) : buffer(buffer), size(size) {}
+
+    // returns false if the calibration failed
+    inline bool setup(Pad::Hardware pad, uint8_t channel) {
+
+        // analog input: no keeper or pull resistors
+        pad.write(Pad::Config().Gpio());
+
+        // enable the module clock
+        CCM_CCGR1 |= CCM_CCGR1_ADC1(CCM_CCGR_ON);
+
+        // IPG clock (150 MHz) divided by 4, high speed, short sample time
+        // and 10 bit results, which is about the fastest the ADC allows
+        // (see [1] chapter 66, ADCx_CFG)
+        ADC1_CFG = ADC_CFG_ADICLK(0) | ADC_CFG_ADIV(2) | ADC_CFG_ADHSC
+            | ADC_CFG_MODE(1) | ADC_CFG_ADSTS(0) | ADC_CFG_OVWREN;
+
+        // calibrate (see [1] chapter 66.5.6)
+        ADC1_GC = ADC_GC_CAL;
+        uint32_t timeout = 10000000;
+        while (ADC1_GC & ADC_GC_CAL)
+            if (timeout-- == 0) return false;
+        if (ADC1_GS & ADC_GS_CALF) {
+            ADC1_GS = ADC_GS_CALF;
+            return false;
+        }
+
+        dma.begin();
+        // the lower half of the result register holds the sample
+        dma.source((volatile uint16_t &) ADC1_R0);
+        dma.destinationBuffer(buffer, size * sizeof(*buffer));
+        dma.triggerAtHardwareEvent(DMAMUX_SOURCE_ADC1);
+        dma.enable();
+
+        // continuous conversions, every result requests a DMA transfer
+        // (see [1] chapter 66, ADCx_GC and ADCx_HC0)
+        ADC1_GC = ADC_GC_ADCO | ADC_GC_DMAEN;
+        ADC1_HC0 = ADC_HC_ADCH(channel);
+
+        return true;
+    }
+
+    inline void reset() {
+        // stop converting (see [1] chapter 66, ADCx_HC0)
+        ADC1_GC = 0;
+        ADC1_HC0 = ADC_HC_ADCH(0x1f);
+        dma.disable();
+    }
+
+    // the ring buffer isn't written while stopped (the ADC keeps on
+    // converting), resuming continues at the same position
+    inline void stop() { dma.disable(); }
+    inline void resume() { dma.enable(); }
+
+    // index of the next sample that will be written
+    inline unsigned position() const {
+        return ((volatile uint16_t*) dma.TCD->DADDR - buffer) % size;
+    }
+
+    inline uint16_t latest() const {
+        return buffer[(position() + size - 1) % size];
+    }
+
+    inline uint16_t at(unsigned i) const { return buffer[i % size]; }
+};
+
+} /* namespace Adc */
+} /* namespace Teensy */
+
+#endif /* TEENSY_ADC_HPP */
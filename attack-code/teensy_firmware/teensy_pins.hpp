@@ -259,8 +259,37 @@ struct Hardware {
 
     bool is_high() const { return get(); }
     bool is_low() const { return !get(); }
+
+    volatile uint32_t *psr() const { return &regs->PSR; }
+};
+
+// A pin known at compile time (see MAKE_PAD), the register address and
+// the mask are immediates instead of loads from a Hardware struct.
+template <uint8_t BANK, uint8_t BIT>
+struct Fixed {
+    static constexpr uint32_t   base = 0x42000000 + 0x4000 * BANK;
+    static constexpr uint32_t   mask = 1u << BIT;
+
+    static_assert(BANK <= 4, "There are only five gpio banks!");
+
+    static Registers &regs() { return *(Registers*) base; }
+
+    static void set_high() { regs().DR_SET = mask; }
+    static void set_low() { regs().DR_CLEAR = mask; }
+
+    // without branch, writing zero to DR_SET (DR_CLEAR) has no effect
+    static void set_high_if(bool on) { regs().DR_SET = mask & -(uint32_t) on; }
+    static void set_low_if(bool on) { regs().DR_CLEAR = mask & -(uint32_t) on; }
+
+    static bool is_high() { return (regs().PSR & mask) != 0; }
+    static bool is_low() { return !is_high(); }
+
+    static volatile uint32_t *psr() { return &regs().PSR; }
 };
 
+template <uint8_t BANK, uint8_t BIT> constexpr uint32_t Fixed<BANK, BIT>::base;
+template <uint8_t BANK, uint8_t BIT> constexpr uint32_t Fixed<BANK, BIT>::mask;
+
 struct SetupScopeGuard;
 
 struct Setup {
@@ -305,7 +334,8 @@ inline SetupScopeGuard TemporarySetup(Setup setup) {
 
 #define MAKE_PAD(NR, NAME, BANK, BIT) \
 constexpr Pad::Hardware Pad ## NR  = { (Pad::Registers*) &IOMUXC_SW_MUX_CTL_PAD_GPIO_ ## NAME }; \
-constexpr Gpio::Hardware Gpio ## NR () { return Gpio::Hardware(Pad ## NR, BANK, BIT); }
+constexpr Gpio::Hardware Gpio ## NR () { return Gpio::Hardware(Pad ## NR, BANK, BIT); } \
+typedef Gpio::Fixed<BANK, BIT> FixedGpio ## NR;
 
 MAKE_PAD(   0,  AD_B0_03,   0,  3   );
 MAKE_PAD(   1,  AD_B0_02,   0,  2   );
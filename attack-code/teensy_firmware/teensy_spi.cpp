@@ -0,0 +1,103 @@
+// Copyright (C) 2021 Niklas Jacob
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+/*
+  [1]:  i.MX RT1060 Processor ReferenceManual
+        https://www.pjrc.com/teensy/IMXRT1060RM_rev2.pdf
+*/
+
+#include "teensy_spi.hpp"
+
+namespace Teensy {
+namespace Spi {
+
+bool Hardware::base_clock_initialized = false;
+
+// Pin configurations working on the teensy
+// (see [1] chapter 11 and https://www.pjrc.com/store/teensy40.html#tech)
+//
+// Note: pin 13 also drives the on-board LED, which slightly loads the
+//       sck line.
+const Hardware Hardware::Pins_10_13_12 = {
+    .regs               = &IMXRT_LPSPI4_S,
+    .clock_gate         = &CCM_CCGR1,
+    .clock_gate_mask    = CCM_CCGR1_LPSPI4(3),
+    .pcs = {
+        .hw     = { Pad10, &IOMUXC_LPSPI4_PCS0_SELECT_INPUT },
+        .cfg    = ModuleInput::Config().Input().Mux(3).Daisy(0),
+    },
+    .sck = {
+        .hw     = { Pad13, &IOMUXC_LPSPI4_SCK_SELECT_INPUT },
+        .cfg    = ModuleInput::Config().Input().Mux(3).Daisy(0),
+    },
+    .sdi = {
+        .hw     = { Pad12, &IOMUXC_LPSPI4_SDI_SELECT_INPUT },
+        .cfg    = ModuleInput::Config().Input().Mux(3).Daisy(0),
+    },
+};
+
+const Hardware Hardware::Pins_0_27_1 = {
+    .regs               = &IMXRT_LPSPI3_S,
+    .clock_gate         = &CCM_CCGR1,
+    .clock_gate_mask    = CCM_CCGR1_LPSPI3(3),
+    .pcs = {
+        .hw     = { Pad0, &IOMUXC_LPSPI3_PCS0_SELECT_INPUT },
+        .cfg    = ModuleInput::Config().Input().Mux(7).Daisy(0),
+    },
+    .sck = {
+        .hw     = { Pad27, &IOMUXC_LPSPI3_SCK_SELECT_INPUT },
+        .cfg    = ModuleInput::Config().Input().Mux(2).Daisy(1),
+    },
+    .sdi = {
+        .hw     = { Pad1, &IOMUXC_LPSPI3_SDI_SELECT_INPUT },
+        .cfg    = ModuleInput::Config().Input().Mux(7).Daisy(0),
+    },
+};
+
+int Sniffer::wait_for_read(uint32_t addr_min, uint32_t addr_max, uint32_t timeout) const {
+
+    uint32_t rsr, rdr;
+
+    while (timeout--) {
+
+        // lost frames?
+        if (regs().SR & LPSPI_SR_REF)
+            return -2;
+
+        // the status belongs to the next word in the FIFO
+        // (see [1] chapter 48, RSR)
+        rsr = regs().RSR;
+        if (rsr & LPSPI_RSR_RXEMPTY)
+            continue;
+
+        rdr = regs().RDR;
+
+        // only the first word of a frame holds command and address
+        if ((rsr & LPSPI_RSR_SOF) == 0)
+            continue;
+
+        if (!is_single_line_read(rdr >> 24))
+            continue;
+
+        rdr &= 0xffffff;
+        if (addr_min <= rdr && rdr <= addr_max)
+            return rdr;
+    }
+
+    return -1;
+}
+
+} /* namespace Spi */
+} /* namespace Teensy */
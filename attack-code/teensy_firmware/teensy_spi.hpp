@@ -0,0 +1,156 @@
+// Copyright (C) 2021 Niklas Jacob
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef TEENSY_SPI_HPP
+#define TEENSY_SPI_HPP
+
+#include <imxrt.h>
+#include "teensy_pins.hpp"
+
+/*
+  [1]:  i.MX RT1060 Processor ReferenceManual
+        https://www.pjrc.com/teensy/IMXRT1060RM_rev2.pdf
+*/
+
+namespace Teensy {
+namespace Spi {
+
+struct Pin {
+    ModuleInput::Hardware   hw;
+    ModuleInput::Config     cfg;
+
+    void setup() const { hw.write(cfg); }
+    void reset() const { hw.pad.write(Pad::Config().Gpio()); }
+};
+
+struct Hardware {
+    IMXRT_LPSPI_t       *regs;
+    volatile uint32_t   *clock_gate;
+    uint32_t            clock_gate_mask;
+    Pin                 pcs;
+    Pin                 sck;
+    Pin                 sdi;
+
+    // Pin configurations working on the teensy
+    // (named after the pcs, sck and sdi pins)
+    static const Hardware Pins_10_13_12;
+    static const Hardware Pins_0_27_1;
+
+    static bool base_clock_initialized;
+    static void setup_base_clock();
+};
+
+inline void Hardware::setup_base_clock() {
+    if (base_clock_initialized) return;
+
+    // Use PLL3 PFD0 (720 MHz) divided by 4 (180 Mhz) as the LPSPI_CLK_ROOT
+    // clock, a slave needs a functional clock well above the sck frequency.
+    // (see [1] chapter 14, CCM_CBCMR)
+    CCM_CBCMR = (CCM_CBCMR & ~(CCM_CBCMR_LPSPI_PODF_MASK | CCM_CBCMR_LPSPI_CLK_SEL_MASK))
+        | CCM_CBCMR_LPSPI_PODF(3) | CCM_CBCMR_LPSPI_CLK_SEL(1);
+
+    base_clock_initialized = true;
+}
+
+// SPI flash commands whose 24 bit address is sent on a single data line,
+// only these can be decoded by a sniffer listening to a single data line.
+enum flash_cmd : uint8_t {
+    flash_cmd_read              = 0x03,
+    flash_cmd_fast_read         = 0x0b,
+    flash_cmd_fast_read_dual    = 0x3b,
+    flash_cmd_fast_read_quad    = 0x6b,
+};
+
+inline bool is_single_line_read(uint8_t cmd) {
+    return cmd == flash_cmd_read
+        || cmd == flash_cmd_fast_read
+        || cmd == flash_cmd_fast_read_dual
+        || cmd == flash_cmd_fast_read_quad;
+}
+
+// Listens in on a SPI bus as a receive-only slave.
+//
+// Every frame (chip-select assertion) is cut into 32 bit words, so the
+// first word of a frame contains the command byte and the 24 bit address
+// of a flash access.
+struct Sniffer {
+    Hardware    hw;
+
+    inline IMXRT_LPSPI_t&  regs() const { return *hw.regs; }
+
+    Sniffer() : hw(Hardware::Pins_10_13_12) {}
+    Sniffer(Hardware hw) : hw(hw) {}
+
+    inline void setup() const {
+
+        hw.setup_base_clock();
+
+        // enable the module clock (also in WAIT mode)
+        *hw.clock_gate |= hw.clock_gate_mask;
+
+        // Reset the module and its FIFOs (see [1] chapter 48, CR)
+        regs().CR = LPSPI_CR_RST | LPSPI_CR_RRF | LPSPI_CR_RTF;
+        regs().CR = 0;
+
+        // Slave mode, SIN is the data input (see [1] chapter 48, CFGR1)
+        regs().CFGR1 = LPSPI_CFGR1_PINCFG(0);
+
+        // Nothing is transmitted, 32 bit frames, MSB first, mode 0
+        // (see [1] chapter 48, TCR)
+        regs().TCR = LPSPI_TCR_FRAMESZ(31) | LPSPI_TCR_TXMSK;
+
+        hw.pcs.setup();
+        hw.sck.setup();
+        hw.sdi.setup();
+    }
+
+    inline void enable() const {
+        // Enable the module (see [1] chapter 48, CR)
+        regs().CR |= LPSPI_CR_MEN;
+    }
+
+    inline void disable() const {
+        // Disable the module (see [1] chapter 48, CR)
+        regs().CR &= ~LPSPI_CR_MEN;
+    }
+
+    inline void reset() const {
+        disable();
+        hw.pcs.reset();
+        hw.sck.reset();
+        hw.sdi.reset();
+    }
+
+    inline void clear() const {
+        // Drop everything received so far and clear the error flags
+        regs().CR |= LPSPI_CR_RRF;
+        regs().SR = LPSPI_SR_REF | LPSPI_SR_TEF | LPSPI_SR_FCF;
+    }
+
+    // Polls the receive FIFO until a read command with an address in
+    // [addr_min, addr_max] starts or the timeout (in polling iterations)
+    // runs out.
+    //
+    // Returns the matched address (always positive) or negative error
+    // codes:
+    //  -1: timeout
+    //  -2: receive FIFO overflow (frames were lost)
+    int wait_for_read(uint32_t addr_min, uint32_t addr_max, uint32_t timeout) const;
+};
+
+} /* namespace Spi */
+} /* namespace Teensy */
+
+#endif /* TEENSY_SPI_HPP */
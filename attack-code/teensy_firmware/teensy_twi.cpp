@@ -18,6 +18,8 @@
         https://www.pjrc.com/teensy/IMXRT1060RM_rev2.pdf
 */
 
+#include <avr/pgmspace.h>
+
 #include "teensy_twi.hpp"
 
 namespace Teensy {
@@ -56,8 +58,93 @@ const Hardware Hardware::Pins_24_25 = {
     .pin_cfg = ModuleInput::Config().Input().Mux(0).Daisy(1),
 };
 
+// Settings that were tested on the hardware
+// (used instead of the computed ones for these baudrates)
+static const struct {
+    uint32_t    baudrate;
+    Timing      timing;
+} tested_timings[] = {
+    //             PRESCALE FILT CLKLO CLKHI DATAVD SETHOLD slave DATAVD
+#if I2C_BASE_CLK == 24000000
+    {  100000, {  2,      14,    31,   23,    15,    54,     30 } },
+    {  400000, {  1,       6,    14,   10,     7,    48,     12 } },
+    { 1000000, {  0,       2,    11,    7,     5,    18,      4 } },
+    // unstable with the 24 MHz base clock
+    { 3000000, {  0,       0,     3,    1,     1,     4,      1 } },
+#elif I2C_BASE_CLK == 60000000
+    {  100000, {  3,      15,    41,   30,    20,    63,     30 } },
+    // c.a. 405 Kbps
+    {  400000, {  2,      13,    19,   13,     9,    32,     26 } },
+    { 1000000, {  0,       6,    30,   20,    15,    50,     15 } },
+    { 3300000, {  0,       3,     7,    4,     3,    21,      3 } },
+    { 4670000, {  0,       1,     6,    2,     2,    10,      2 } },
+#endif
+};
+
+bool Timing::of_baudrate(uint32_t baudrate, Timing &t) {
+
+    for (auto &tested : tested_timings) {
+        if (tested.baudrate == baudrate) {
+            t = tested.timing;
+            return true;
+        }
+    }
+
+    if (baudrate == 0) return false;
+
+    // base clock cycles per bit
+    const uint32_t cycles = (I2C_BASE_CLK + baudrate / 2) / baudrate;
+
+    // filter glitches shorter than a tenth of a bit
+    t.filt = cycles / 10 > 15 ? 15 : cycles / 10;
+
+    // use the smallest prescaler for which CLKLO and CLKHI (6 bits) fit
+    for (uint8_t prescale = 0; prescale < 8; prescale++) {
+
+        // CLKHI + CLKLO
+        int32_t rest = (int32_t) (cycles >> prescale) - 2 - ((2 + t.filt) >> prescale);
+        if (rest > 2 * 63)
+            continue;
+
+        // too fast (CLKLO must be at least 3, CLKHI at least 1)
+        if (rest < 4)
+            return false;
+
+        // CLKLO is usually higher than CLKHI (see manual [1] page 2751),
+        // split as in the tested settings (about 60:40)
+        t.prescale = prescale;
+        t.clklo = (rest * 3 + 4) / 5;
+        if (t.clklo > 63) t.clklo = 63;
+        t.clkhi = rest - t.clklo;
+
+        // DATAVD must be between 1 and CLKLO - 2
+        t.datavd = t.clklo / 2;
+        if (t.datavd > t.clklo - 2) t.datavd = t.clklo - 2;
+        if (t.datavd < 1) t.datavd = 1;
+
+        // SETHOLD must be above 2
+        t.sethold = rest > 63 ? 63 : rest < 3 ? 3 : rest;
+
+        // the slave counts in base clock cycles
+        t.slave_datavd = (t.datavd << prescale) > 63 ? 63 : t.datavd << prescale;
+
+        return true;
+    }
+
+    // too slow
+    return false;
+}
+
 // Returns zero on success, negative error codes on error
-int Master::send_u16(uint8_t address, uint16_t message, uint32_t timeout) {
+FASTRUN int Master::send_u16(uint8_t address, uint16_t message, uint32_t timeout) {
+
+    int rc = start_u16(address, message, timeout);
+    if (rc < 0) return rc;
+
+    return finish(timeout);
+}
+
+FASTRUN int Master::start_u16(uint8_t address, uint16_t message, uint32_t timeout) {
 
     // sanity check address
     if ((address >> 7) != 0) return -2;
@@ -87,6 +174,38 @@ int Master::send_u16(uint8_t address, uint16_t message, uint32_t timeout) {
     // send stop condition
     regs().MTDR = LPI2C_MTDR_CMD_STOP;
 
+    return 0;
+}
+
+// Queues a packet behind the one being transmitted (start_u16), as soon
+// as the fifo has room for its words, so both go out in one burst.
+FASTRUN int Master::queue_u16(uint8_t address, uint16_t message, uint32_t timeout) {
+
+    // sanity check address
+    if ((address >> 7) != 0) return -2;
+
+    const uint32_t words[] = {
+        LPI2C_MTDR_CMD_START | LPI2C_MTDR_DATA(address << 1),
+        LPI2C_MTDR_CMD_TRANSMIT | LPI2C_MTDR_DATA(message),
+        LPI2C_MTDR_CMD_TRANSMIT | LPI2C_MTDR_DATA(message >> 8),
+        LPI2C_MTDR_CMD_STOP,
+    };
+
+    // transmit fifo size (see [1] pages 2759-2760)
+    const uint32_t fifo_size = 1 << (regs().PARAM & 0xf);
+
+    for (uint32_t word : words) {
+        while ((regs().MFSR & 0x7) >= fifo_size)
+            if (timeout-- == 0)
+                return (1<<31) | (1<<29) | regs().MFSR;
+        regs().MTDR = word;
+    }
+
+    return 0;
+}
+
+FASTRUN int Master::finish(uint32_t timeout) {
+
     while (
             // fifos not empty
             (regs().MFSR & 0x7) != 0
@@ -57,42 +57,71 @@ struct Hardware {
     static void setup_base_clock();
 };
 
+// Use 400Kbps as a default baudrate
+#ifndef I2C_BAUDRATE
+#  warning I2C_BAUDRATE not specified, using 400000 (400 Kbps).
+#  define I2C_BAUDRATE 400000
+#endif 
+
+// Timing parameters of the LPI2C (see [1] pages 2749-2751 and 2770-2775)
+//
+// The base clock cycles it takes to transmit one bit are:
+//  (2 + floor((2 + FILTSCL)/2^PRESCALE) + CLKHI + CLKLO) * 2^PRESCALE
+//
+// FILTSDA is set equal to FILTSCL.
+struct Timing {
+    uint8_t     prescale;
+    uint8_t     filt;
+    uint8_t     clklo;
+    uint8_t     clkhi;
+    uint8_t     datavd;
+    uint8_t     sethold;
+    uint8_t     slave_datavd;
+
+    // Returns false if the baudrate can't be reached with the base clock.
+    static bool of_baudrate(uint32_t baudrate, Timing &t);
+
+    inline uint32_t bit_cycles() const {
+        return (2 + ((2 + filt) >> prescale) + clkhi + clklo) << prescale;
+    }
+
+    // the baudrate the parameters actually give
+    inline uint32_t baudrate() const { return I2C_BASE_CLK / bit_cycles(); }
+};
+
 struct HardwareSetup {
     Hardware    hw;
     uint8_t     pincfg;
+    uint32_t    baudrate;
+
+    inline HardwareSetup Baudrate(uint32_t b) const { auto r = *this; r.baudrate = b; return r; }
 
     bool verify() const;
     void reset() const;
     void setup() const;
 };
 
-// Use 400Kbps as a default baudrate
-#ifndef I2C_BAUDRATE
-#  warning I2C_BAUDRATE not specified, using 400000 (400 Kbps).
-#  define I2C_BAUDRATE 400000
-#endif 
-
 inline HardwareSetup Hardware::input_only() const {
-    HardwareSetup cfg = { .hw = *this, .pincfg = 0 };
+    HardwareSetup cfg = { .hw = *this, .pincfg = 0, .baudrate = I2C_BAUDRATE };
     cfg.hw.pin_cfg.pad = cfg.hw.pin_cfg.pad.Input();
     return cfg;
 }
 
 inline HardwareSetup Hardware::open_drain() const {
-    HardwareSetup cfg = { .hw = *this, .pincfg = 0 };
+    HardwareSetup cfg = { .hw = *this, .pincfg = 0, .baudrate = I2C_BAUDRATE };
     cfg.hw.pin_cfg.pad = cfg.hw.pin_cfg.pad.OpenDrain().PullUp().Output();
     return cfg;
 }
 
 inline HardwareSetup Hardware::open_drain_output_only() const {
-    HardwareSetup cfg = { .hw = *this, .pincfg = 1 };
+    HardwareSetup cfg = { .hw = *this, .pincfg = 1, .baudrate = I2C_BAUDRATE };
     //cfg.hw.pin_cfg.pad = cfg.hw.pin_cfg.pad.OpenDrain().PullUp().Output();
     cfg.hw.pin_cfg.pad = cfg.hw.pin_cfg.pad.OpenDrain().Output();
     return cfg;
 }
 
 inline HardwareSetup Hardware::push_pull() const {
-    HardwareSetup cfg = { .hw = *this, .pincfg = 2 };
+    HardwareSetup cfg = { .hw = *this, .pincfg = 2, .baudrate = I2C_BAUDRATE };
     cfg.hw.pin_cfg.pad = cfg.hw.pin_cfg.pad.Output();
     return cfg;
 }
@@ -164,163 +193,22 @@ inline void HardwareSetup::setup() const {
         | LPI2C_MCFGR1_PINCFG(pincfg);
 
     // Set timing parameters (see [1] pages 2749-2751, 2770-2772 and 2774-2775)
-    // These are:
-    //      - DATAVD
-    //      - SETHOLD
-    //      - CLKHI
-    //      - CLKLO
-    //      - FILTSDA
-    //      - FILTSCL
-    //      - PRESCALE
     // The others will be left as their defaults
     //      - BUSIDLE = 0 (no timeout)
-    //
-    // In this case the base clock cycles it takes to transmit on bit are:
-    //  (2 + floor((2 + FILTSCL)/2^PRESCALE) + CLKHI + CLKLO) * 2^PRESCALE
-    //
-    // with PRESCALE = 0:
-    //  4 + FILTSCL + CLKHI + CLKLO
-    //
-    // with PRESCALE = 1:
-    //  4 + 2*(floor(1 + FILTSCL/2) + CLKHI + CLKLO )
-    //
-    // with PRESCALE = 2:
-    //  8 + 4*(floor(1/2 + FILTSCL/4) + CLKHI + CLKLO )
-    //
-    // with PRESCALE = 3:
-    //  16 + 8*(floor(1/4 + FILTSCL/8) + CLKHI + CLKLO )
-    //
-    // So we will set PRESCALE, FILTSCL, CLKLO and CLKHI them accordingly for each baudrate.
-    // For simplicity we set FILTSDA equal to FILTSCL.
-
-    #if I2C_BASE_CLK == 24000000 // 24 MHz
-    // | Baudrate | PRESCALE | CLKLO | CLKHI | FILTSCL | Total Cycles |
-    // |----------|----------|-------|-------|---------|--------------|
-    // | 100 Kbps |        2 |    31 |    23 |      14 |          240 |
-    // | 400 Kbps |        1 |    14 |    10 |       6 |           60 |
-    // |   1 Mbps |        0 |    11 |     7 |       2 |           24 |
-    // |   3 Mbps |        0 |     3 |     1 |       0 |            8 |
-    //
-    // Note: CLKLO is usually higher than CLKHI (see manual [1] page 2751).
-    // TODO: check the HI-LO differences (against I2C spec. or by experiments)
-    //
-    // DATAVD must be between 1 and CLKLO - 2
-    // SETHOLD must be above 2
-    //
-    // | Baudrate | DATAVD | SETHOLD |
-    // |----------|--------|---------|
-    // | 100 Kbps |     15 |      54 |
-    // | 400 Kbps |      7 |      48 |
-    // |   1 Mbps |      5 |      18 |
-    // |   3 Mbps |      1 |       4 |
-    
-    #if I2C_BAUDRATE == 100000
-    hw.regs->MCFGR1 |= LPI2C_MCFGR1_PRESCALE(2);
-    hw.regs->MCCR0 |= LPI2C_MCCR0_DATAVD(15)
-                    | LPI2C_MCCR0_SETHOLD(54)
-                    | LPI2C_MCCR0_CLKHI(23)
-                    | LPI2C_MCCR0_CLKLO(31);
-    hw.regs->MCFGR2 |= LPI2C_MCFGR2_FILTSDA(14) | LPI2C_MCFGR2_FILTSCL(14);
-    hw.regs->SCFGR2 |= LPI2C_SCFGR2_FILTSDA(14) | LPI2C_SCFGR2_FILTSCL(14)
-                    | LPI2C_SCFGR2_DATAVD(30);
-    #elif I2C_BAUDRATE == 400000
-    hw.regs->MCFGR1 |= LPI2C_MCFGR1_PRESCALE(1);
-    hw.regs->MCCR0 |= LPI2C_MCCR0_DATAVD(7)
-                    | LPI2C_MCCR0_SETHOLD(48)
-                    | LPI2C_MCCR0_CLKHI(10)
-                    | LPI2C_MCCR0_CLKLO(14);
-    hw.regs->MCFGR2 |= LPI2C_MCFGR2_FILTSDA(6) | LPI2C_MCFGR2_FILTSCL(6);
-    hw.regs->SCFGR2 |= LPI2C_SCFGR2_FILTSDA(6) | LPI2C_SCFGR2_FILTSCL(6)
-                    | LPI2C_SCFGR2_DATAVD(12);
-    #elif I2C_BAUDRATE == 1000000
-    hw.regs->MCCR0 |= LPI2C_MCCR0_DATAVD(5)
-                    | LPI2C_MCCR0_SETHOLD(18)
-                    | LPI2C_MCCR0_CLKHI(7);
-                    | LPI2C_MCCR0_CLKLO(11);
-    hw.regs->MCFGR2 |= LPI2C_MCFGR2_FILTSDA(2) | LPI2C_MCFGR2_FILTSCL(2);
-    hw.regs->SCFGR2 |= LPI2C_SCFGR2_FILTSDA(2) | LPI2C_SCFGR2_FILTSCL(2)
-                    | LPI2C_SCFGR2_DATAVD(4);
-    #elif I2C_BAUDRATE == 3000000
-    #  warning "A 3 Mbps baud rate is unstable with a 24 MHz baseclock!"
-    hw.regs->MCCR0 |= LPI2C_MCCR0_DATAVD(1)
-                    | LPI2C_MCCR0_SETHOLD(4)
-                    | LPI2C_MCCR0_CLKHI(1)
-                    | LPI2C_MCCR0_CLKLO(3);
-    hw.regs->SCFGR2 |= LPI2C_SCFGR2_DATAVD(1);
-    #else
-    #  error Unknown I2C_BAUDRATE value, use 100000, 400000, 1000000 or 3000000!
-    #endif
-
-    #elif I2C_BASE_CLK == 60000000
-    // | Baudrate | PRESCALE |FILTSCL |  CLKLO | CLKHI | Total Cycles |
-    // |----------|----------|--------|--------|-------|--------------|
-    // | 100 Kbps |        3 |     15 |     41 |    30 |          600 |
-    // | 400 Kbps |        2 |     13 |     19 |    13 |          152 | (c.a. 405 Kbps)
-    // |   1 Mbps |        0 |      6 |     30 |    20 |           60 |
-    // | 3.3 Mbps |        0 |      3 |      7 |     4 |           18 |
-    //
-    // Note: CLKLO is usually higher than CLKHI (see manual [1] page 2751).
-    // TODO: check the HI-LO differences (against I2C spec. or by experiments)
-    //
-    // DATAVD must be between 1 and CLKLO - 2
-    // SETHOLD must be above 2
-    //
-    // | Baudrate | DATAVD | SETHOLD |
-    // |----------|--------|---------|
-    // | 100 Kbps |     20 |      63 |
-    // | 400 Kbps |      9 |      32 |
-    // |   1 Mbps |     15 |      50 |
-    // | 3.3 Mbps |      3 |      11 |
-    
-    #if I2C_BAUDRATE == 100000
-    hw.regs->MCFGR1 |= LPI2C_MCFGR1_PRESCALE(3);
-    hw.regs->MCCR0 |= LPI2C_MCCR0_DATAVD(20)
-                    | LPI2C_MCCR0_SETHOLD(63)
-                    | LPI2C_MCCR0_CLKHI(30)
-                    | LPI2C_MCCR0_CLKLO(41);
-    hw.regs->MCFGR2 |= LPI2C_MCFGR2_FILTSDA(15) | LPI2C_MCFGR2_FILTSCL(15);
-    hw.regs->SCFGR2 |= LPI2C_SCFGR2_FILTSDA(15) | LPI2C_SCFGR2_FILTSCL(15)
-                    | LPI2C_SCFGR2_DATAVD(30);
-    #elif I2C_BAUDRATE == 400000
-    hw.regs->MCFGR1 |= LPI2C_MCFGR1_PRESCALE(2);
-    hw.regs->MCCR0 |= LPI2C_MCCR0_DATAVD(9)
-                    | LPI2C_MCCR0_SETHOLD(32)
-                    | LPI2C_MCCR0_CLKHI(13)
-                    | LPI2C_MCCR0_CLKLO(19);
-    hw.regs->MCFGR2 |= LPI2C_MCFGR2_FILTSDA(13) | LPI2C_MCFGR2_FILTSCL(13);
-    hw.regs->SCFGR2 |= LPI2C_SCFGR2_FILTSDA(13) | LPI2C_SCFGR2_FILTSCL(13)
-                    | LPI2C_SCFGR2_DATAVD(26);
-    #elif I2C_BAUDRATE == 1000000
-    hw.regs->MCCR0 |= LPI2C_MCCR0_DATAVD(15)
-                    | LPI2C_MCCR0_SETHOLD(50)
-                    | LPI2C_MCCR0_CLKHI(20)
-                    | LPI2C_MCCR0_CLKLO(30);
-    hw.regs->MCFGR2 |= LPI2C_MCFGR2_FILTSDA(6) | LPI2C_MCFGR2_FILTSCL(6);
-    hw.regs->SCFGR2 |= LPI2C_SCFGR2_FILTSDA(6) | LPI2C_SCFGR2_FILTSCL(6)
-                    | LPI2C_SCFGR2_DATAVD(15);
-    #elif I2C_BAUDRATE == 3300000
-    hw.regs->MCCR0 |= LPI2C_MCCR0_DATAVD(3)
-                    | LPI2C_MCCR0_SETHOLD(21)
-                    | LPI2C_MCCR0_CLKHI(4)
-                    | LPI2C_MCCR0_CLKLO(7);
-    hw.regs->MCFGR2 |= LPI2C_MCFGR2_FILTSDA(3) | LPI2C_MCFGR2_FILTSCL(3);
-    hw.regs->SCFGR2 |= LPI2C_SCFGR2_FILTSDA(3) | LPI2C_SCFGR2_FILTSCL(3)
-                    | LPI2C_SCFGR2_DATAVD(3);
-    #elif I2C_BAUDRATE == 4670000
-    hw.regs->MCCR0 |= LPI2C_MCCR0_DATAVD(2)
-                    | LPI2C_MCCR0_SETHOLD(10)
-                    | LPI2C_MCCR0_CLKHI(2)
-                    | LPI2C_MCCR0_CLKLO(6);
-    hw.regs->MCFGR2 |= LPI2C_MCFGR2_FILTSDA(1) | LPI2C_MCFGR2_FILTSCL(1);
-    hw.regs->SCFGR2 |= LPI2C_SCFGR2_FILTSDA(1) | LPI2C_SCFGR2_FILTSCL(1)
-                    | LPI2C_SCFGR2_DATAVD(2);
-    #else
-    #  error Unknown I2C_BAUDRATE value, use 100000, 400000, 1000000, 3300000 or 4670000!
-    #endif
+    Timing t;
+    if (!Timing::of_baudrate(baudrate, t))
+        Timing::of_baudrate(I2C_BAUDRATE, t);
 
-    #else
-    #  error Unknown I2C_BASE_CLK value, use 24000000 or 60000000!
-    #endif
+    hw.regs->MCFGR1 =
+        (hw.regs->MCFGR1 & ~LPI2C_MCFGR1_PRESCALE(7))
+        | LPI2C_MCFGR1_PRESCALE(t.prescale);
+    hw.regs->MCCR0 = LPI2C_MCCR0_DATAVD(t.datavd)
+                    | LPI2C_MCCR0_SETHOLD(t.sethold)
+                    | LPI2C_MCCR0_CLKHI(t.clkhi)
+                    | LPI2C_MCCR0_CLKLO(t.clklo);
+    hw.regs->MCFGR2 = LPI2C_MCFGR2_FILTSDA(t.filt) | LPI2C_MCFGR2_FILTSCL(t.filt);
+    hw.regs->SCFGR2 = LPI2C_SCFGR2_FILTSDA(t.filt) | LPI2C_SCFGR2_FILTSCL(t.filt)
+                    | LPI2C_SCFGR2_DATAVD(t.slave_datavd);
 }
 
 struct MasterConfig {
@@ -358,8 +246,30 @@ struct Master {
         regs().MCR &= ~LPI2C_MCR_MEN;
     }
 
+    // Changes the baudrate (the master is reset meanwhile),
+    // returns false if it can't be reached.
+    inline bool set_baudrate(uint32_t baudrate) {
+        Timing t;
+        if (!Timing::of_baudrate(baudrate, t))
+            return false;
+        hw.baudrate = baudrate;
+        setup();
+        enable();
+        return true;
+    }
+
     // Returns MCR on success, negative error codes on error
     int send_u16(uint8_t address, uint16_t message, uint32_t timeout);
+
+    // send_u16 in two halves: start_u16 queues the packet and returns
+    // while it is being transmitted, finish waits until it was sent.
+    // Both return negative error codes on error (like send_u16).
+    int start_u16(uint8_t address, uint16_t message, uint32_t timeout);
+    int finish(uint32_t timeout);
+
+    // Queues a second packet after start_u16, it is sent back-to-back with
+    // the first one (finish waits for both).
+    int queue_u16(uint8_t address, uint16_t message, uint32_t timeout);
 };
 
 enum addrcfg : uint8_t {
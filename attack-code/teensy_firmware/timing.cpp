@@ -0,0 +1,170 @@
+// Copyright (C) 2021 Niklas Jacob
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "io.h"
+#include "histogram.h"
+
+#include "timing.h"
+
+bool        timing_adaptive     = DefaultTimingAdaptive;
+uint32_t    timing_percentile   = DefaultTimingPercentile;
+uint32_t    timing_margin       = DefaultTimingMargin;
+uint32_t    timing_min_samples  = DefaultTimingMinSamples;
+
+const char * const timing_phase_names[TimingPhases] = {
+    "cs_low ",
+    "cs_high",
+    "ping   ",
+};
+
+histogram   timing_histograms[TimingPhases];
+
+// learned timeouts (zero if not enough samples)
+uint32_t    timing_learned[TimingPhases];
+bool        timing_dirty        = true;
+
+FASTRUN void timing_record(uint8_t phase, uint32_t time) {
+    timing_histograms[phase].add(time);
+    timing_dirty = true;
+}
+
+FASTRUN uint32_t timing_timeout(uint8_t phase, uint32_t fixed) {
+    uint32_t learned = timing_learned[phase];
+    if (!timing_adaptive || learned == 0 || learned > fixed)
+        return fixed;
+    return learned;
+}
+
+bool timing_update() {
+
+    for (unsigned i = 0; i < TimingPhases; i++) {
+        const histogram &h = timing_histograms[i];
+        if (h.total < timing_min_samples || h.total == 0) {
+            timing_learned[i] = 0;
+            continue;
+        }
+        uint64_t t = h.percentile(timing_percentile);
+        t += t * timing_margin / 100;
+        timing_learned[i] = t > 0xffffffff ? 0xffffffff : (t ? t : 1);
+    }
+
+    timing_dirty = false;
+    return true;
+}
+
+void timing_process() {
+    if (timing_dirty)
+        timing_update();
+}
+
+bool timing_show(void * pThis) {
+    timing_update();
+    println("phase   | samples    | median     | percentile | learned");
+    println("--------|------------|------------|------------|-----------");
+    for (unsigned i = 0; i < TimingPhases; i++) {
+        const histogram &h = timing_histograms[i];
+        print_str(timing_phase_names[i]);
+        print_str(" | ");
+        print_hex_int(h.total);
+        print_str(" | ");
+        print_hex_int(h.percentile(500));
+        print_str(" | ");
+        print_hex_int(h.percentile(timing_percentile));
+        print_str(" | ");
+        print_hex_int(timing_learned[i]);
+        println();
+    }
+    if (!timing_adaptive)
+        println("Note: The learned timeouts are not used (timing adaptive)!");
+    return true;
+}
+
+bool timing_clear(void * pThis) {
+    for (unsigned i = 0; i < TimingPhases; i++)
+        timing_histograms[i].clear();
+    timing_update();
+    println("Recorded times cleared!");
+    return true;
+}
+
+bool timing_u32_set(void * pThis, const char * value, unsigned n) {
+    return cli_param_u32_set(pThis, value, n) && timing_update();
+}
+
+bool timing_u32_reset(void * pThis) {
+    return cli_param_u32_reset(pThis) && timing_update();
+}
+
+cli_param_bool timing_adaptive_this     = make_cli_param_bool(timing_adaptive, DefaultTimingAdaptive);
+cli_param_u32  timing_percentile_this   = make_cli_param_u32(timing_percentile,     DefaultTimingPercentile,    500, 1000);
+cli_param_u32  timing_margin_this       = make_cli_param_u32(timing_margin,         DefaultTimingMargin,        0, 1000);
+cli_param_u32  timing_min_samples_this  = make_cli_param_u32(timing_min_samples,    DefaultTimingMinSamples,    1, 0xffffffff);
+
+cli_param timing_min_samples_param = {
+    .name           = "min_samples",
+    .description    = timing_min_samples_desc,
+    .pThis          = &timing_min_samples_this,
+    .set            = timing_u32_set,
+    .reset          = timing_u32_reset,
+    .print          = cli_param_u32_print,
+    .next           = 0,
+};
+
+cli_param timing_margin_param = {
+    .name           = "margin",
+    .description    = timing_margin_desc,
+    .pThis          = &timing_margin_this,
+    .set            = timing_u32_set,
+    .reset          = timing_u32_reset,
+    .print          = cli_param_u32_print,
+    .next           = &timing_min_samples_param,
+};
+
+cli_param timing_percentile_param = {
+    .name           = "percentile",
+    .description    = timing_percentile_desc,
+    .pThis          = &timing_percentile_this,
+    .set            = timing_u32_set,
+    .reset          = timing_u32_reset,
+    .print          = cli_param_u32_print,
+    .next           = &timing_margin_param,
+};
+
+cli_param timing_adaptive_param = make_cli_param_bool_param("adaptive", timing_adaptive_desc, timing_adaptive_this, &timing_percentile_param);
+
+cli_command timing_clear_cmd = {
+    .name           = "clear",
+    .description    = timing_clear_cmd_desc,
+    .pThis          = 0,
+    .exec           = &timing_clear,
+    .next           = 0,
+};
+
+cli_command timing_cmd = {
+    .name           = "",
+    .description    = timing_cmd_desc,
+    .pThis          = 0,
+    .exec           = &timing_show,
+    .next           = &timing_clear_cmd,
+};
+
+cli_module timing_module = {
+    .name           = "timing",
+    .description    = timing_mod_desc,
+    .param          = &timing_adaptive_param,
+    .cmd            = &timing_cmd,
+    .next           = 0,
+};
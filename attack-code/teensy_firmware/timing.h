@@ -0,0 +1,78 @@
+// Copyright (C) 2021 Niklas Jacob
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef TIMING_H
+#define TIMING_H
+
+#include "hw.h"
+#include "cli.h"
+
+
+enum timing_phase : uint8_t {
+    timing_cs_low,      // width of a chip-select low-pulse
+    timing_cs_high,     // time between two chip-select low-pulses
+    timing_ping,        // from the end of the glitch to the next pulse
+    TimingPhases,
+};
+
+constexpr bool      DefaultTimingAdaptive   = false;
+constexpr uint32_t  DefaultTimingPercentile = 999; // permille
+constexpr uint32_t  DefaultTimingMargin     = 50;  // percent
+constexpr uint32_t  DefaultTimingMinSamples = 32;
+
+// records a measured time (in busy loop cycles) of a clean boot
+void timing_record(uint8_t phase, uint32_t time);
+
+// The timeout of a phase: the fixed timeout, or the learned one if
+// timing adaptive is set, enough times were recorded and it's shorter.
+// (Only reads a cached value, the cache is updated by timing_process.)
+uint32_t timing_timeout(uint8_t phase, uint32_t fixed);
+
+void timing_process();
+
+
+#define timing_mod_desc \
+    "Learns how long the phases of clean boots take and derives the\r\n" \
+    "timeouts of the attack and glitch modules from them:\r\n" \
+    "  cs_low  -> chip-select low-pulse (attack waits, glitch cs_timeout)\r\n" \
+    "  cs_high -> between chip-select pulses (attack waits)\r\n" \
+    "  ping    -> from the glitch to the next pulse (glitch ping_wait)\r\n" \
+    "The pulses are recorded by \"attack calibrate\" and while waiting\r\n" \
+    "for the glitch, the ping latency of every attempt with a ping.\r\n" \
+    "A learned timeout is the percentile of the recorded times plus\r\n" \
+    "margin, it is never longer than the fixed timeout.\r\n" \
+    "Note: The ping latency depends on the glitch delay, clear the\r\n" \
+    "      recorded times when moving to another delay window."
+#define timing_cmd_desc \
+    "Prints the recorded times and the timeouts in use (busy loop cycles)."
+#define timing_clear_cmd_desc \
+    "Clears the recorded times."
+
+#define timing_adaptive_desc \
+    "Whether the learned timeouts are used."
+#define timing_percentile_desc \
+    "The percentile (in permille) of the recorded times used for the\r\n" \
+    "timeouts."
+#define timing_margin_desc \
+    "How many percent are added to the percentile."
+#define timing_min_samples_desc \
+    "How many times of a phase have to be recorded before its learned\r\n" \
+    "timeout is used."
+
+extern cli_module timing_module;
+
+
+#endif /* TIMING_H */
@@ -0,0 +1,202 @@
+// Copyright (C) 2021 Niklas Jacob
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "io.h"
+
+#include "trace.h"
+
+bool        trace_enabled       = DefaultTraceEnabled;
+uint32_t    trace_count         = 0;
+trace_entry trace_entries[TraceSize];
+
+uint32_t    trace_last_cycles   = 0;
+uint32_t    trace_last_ms       = 0;
+uint32_t    trace_wraps         = 0;
+
+// results and errors have no end, they are shown for TraceStrobeNs
+constexpr uint32_t TraceStrobeNs = 1000;
+
+const struct {
+    const char  *name;
+    uint8_t     width;
+    bool        strobe;
+} trace_signals[TraceSignals] = {
+    { "attack",     1,  false },
+    { "glitch",     1,  false },
+    { "running",    1,  false },
+    { "success",    1,  false },
+    { "broken",     1,  false },
+    { "restart",    1,  false },
+    { "reset",      1,  false },
+    { "cs",         1,  false },
+    { "target",     8,  false },
+    { "packet",     24, false },
+    { "result",     8,  true },
+    { "error",      32, true },
+};
+
+void trace_print_dec(uint64_t v) {
+    char str[20];
+    unsigned n = 0;
+    do {
+        str[sizeof(str) - ++n] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    print_str(str + sizeof(str) - n, n);
+}
+
+// the time of the last "#<time>" line
+uint64_t trace_vcd_now;
+
+void trace_vcd_time(uint64_t ns) {
+    if (ns == trace_vcd_now) return;
+    trace_vcd_now = ns;
+    print_char('#');
+    trace_print_dec(ns);
+    println();
+}
+
+void trace_vcd_value(uint8_t signal, uint32_t value) {
+    uint8_t width = trace_signals[signal].width;
+    if (width == 1) {
+        print_char(value == TraceNone ? 'x' : value ? '1' : '0');
+    } else {
+        print_char('b');
+        if (value == TraceNone)
+            print_char('z');
+        else
+            for (unsigned i = width; i--; )
+                print_char(value & (1u << i) ? '1' : '0');
+        print_char(' ');
+    }
+    print_char('!' + signal);
+    println();
+}
+
+// pending ends of the strobe signals (0 if none)
+uint64_t trace_vcd_release[TraceSignals];
+
+// Prints the ends of the strobes until the given time.
+void trace_vcd_release_until(uint64_t ns) {
+    while (true) {
+        unsigned next = TraceSignals;
+        for (unsigned i = 0; i < TraceSignals; i++)
+            if (trace_vcd_release[i] && trace_vcd_release[i] <= ns)
+                if (next == TraceSignals || trace_vcd_release[i] < trace_vcd_release[next])
+                    next = i;
+        if (next == TraceSignals) return;
+        trace_vcd_time(trace_vcd_release[next]);
+        trace_vcd_value(next, TraceNone);
+        trace_vcd_release[next] = 0;
+    }
+}
+
+bool trace_show(void *) {
+    print_hex_param("events", trace_count < TraceSize ? trace_count : TraceSize, int);
+    print_hex_param("dropped", trace_count < TraceSize ? 0 : trace_count - TraceSize, int);
+    return true;
+}
+
+bool trace_vcd(void *) {
+
+    const uint32_t end = trace_count;
+    const uint32_t begin = end < TraceSize ? 0 : end - TraceSize;
+
+    println("$comment amd-sp-glitch firmware trace $end");
+    println("$timescale 1ns $end");
+    println("$scope module teensy $end");
+    for (unsigned i = 0; i < TraceSignals; i++) {
+        print_str("$var wire ");
+        trace_print_dec(trace_signals[i].width);
+        print_char(' ');
+        print_char('!' + i);
+        print_char(' ');
+        print_str(trace_signals[i].name);
+        println(" $end");
+    }
+    println("$upscope $end");
+    println("$enddefinitions $end");
+
+    trace_vcd_now = 0;
+    println("#0");
+    println("$dumpvars");
+    for (unsigned i = 0; i < TraceSignals; i++) {
+        trace_vcd_value(i, TraceNone);
+        trace_vcd_release[i] = 0;
+    }
+    println("$end");
+
+    const uint64_t first = trace_entries[begin & (TraceSize - 1)].cycles;
+
+    for (uint32_t i = begin; i != end; i++) {
+        const trace_entry &e = trace_entries[i & (TraceSize - 1)];
+        uint64_t cycles = e.cycles - first;
+
+        // the first event is at 1 ns (after the initial values)
+        uint64_t ns = cycles * 1000 / (F_CPU_ACTUAL / 1000000) + 1;
+
+        trace_vcd_release_until(ns);
+        trace_vcd_time(ns);
+        trace_vcd_value(e.signal, e.value);
+        if (trace_signals[e.signal].strobe)
+            trace_vcd_release[e.signal] = ns + TraceStrobeNs;
+    }
+
+    trace_vcd_release_until(~0ull);
+
+    return true;
+}
+
+bool trace_clear(void *) {
+    trace_count = 0;
+    println("Trace cleared!");
+    return true;
+}
+
+cli_param_bool trace_enabled_this = make_cli_param_bool(trace_enabled, DefaultTraceEnabled);
+cli_param trace_enabled_param = make_cli_param_bool_param("enabled", trace_enabled_desc, trace_enabled_this, 0);
+
+cli_command trace_clear_cmd = {
+    .name           = "clear",
+    .description    = trace_clear_cmd_desc,
+    .pThis          = 0,
+    .exec           = &trace_clear,
+    .next           = 0,
+};
+
+cli_command trace_vcd_cmd = {
+    .name           = "vcd",
+    .description    = trace_vcd_cmd_desc,
+    .pThis          = 0,
+    .exec           = &trace_vcd,
+    .next           = &trace_clear_cmd,
+};
+
+cli_command trace_cmd = {
+    .name           = "",
+    .description    = trace_cmd_desc,
+    .pThis          = 0,
+    .exec           = &trace_show,
+    .next           = &trace_vcd_cmd,
+};
+
+cli_module trace_module = {
+    .name           = "trace",
+    .description    = trace_mod_desc,
+    .param          = &trace_enabled_param,
+    .cmd            = &trace_cmd,
+    .next           = 0,
+};
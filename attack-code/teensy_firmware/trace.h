@@ -0,0 +1,135 @@
+// Copyright (C) 2021 Niklas Jacob
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <imxrt.h>
+#include <core_pins.h>
+
+// (no hw.h here, amd_svi2.hpp traces the packets it sends)
+#include "cli.h"
+
+
+/*
+
+Ring buffer of time stamped firmware events (signal changes). Recording an
+event stores the cycle counter (extended to 64 bits, see trace_cycles) and
+the new value of the signal.
+
+`trace vcd` dumps the buffer as a value change dump (VCD).
+
+*/
+
+enum trace_signal : uint8_t {
+    trace_attack,       // the attack trigger (1 bit)
+    trace_glitch,       // the glitch trigger (1 bit)
+    trace_running,      // the target running trigger (1 bit)
+    trace_success,      // the success trigger (1 bit)
+    trace_broken,       // the target broken trigger (1 bit)
+    trace_restart,      // the restart trigger (1 bit)
+    trace_reset,        // the reset pin is pulled low (1 bit)
+    trace_cs,           // chip-select edges seen (1 bit)
+    trace_target,       // restart status (8 bits)
+    trace_packet,       // the svi2 packet on the bus (24 bits)
+    trace_result,       // glitch result (8 bits)
+    trace_error,        // error code (32 bits)
+    TraceSignals,
+};
+
+// the value of a vector signal while it isn't driven
+constexpr uint32_t TraceNone        = 0xffffffff;
+
+// events (must be a power of two)
+constexpr unsigned TraceSize        = 4096;
+
+// (an event costs the triggers and packets a few dozen cycles)
+constexpr bool DefaultTraceEnabled  = false;
+
+// the cycle counter overflows every ~7 s (at 600 MHz), longer gaps between
+// events than this are measured with millis()
+constexpr uint32_t TraceLongGapMs   = 3000;
+
+typedef struct trace_entry {
+    uint64_t    cycles;
+    uint32_t    value;
+    uint8_t     signal;
+} trace_entry;
+
+extern bool         trace_enabled;
+extern uint32_t     trace_count;
+extern trace_entry  trace_entries[TraceSize];
+
+// the cycle counter and millis() at the last event, the overflows so far
+extern uint32_t     trace_last_cycles;
+extern uint32_t     trace_last_ms;
+extern uint32_t     trace_wraps;
+
+// Extends the cycle counter to 64 bits. Between close events it overflowed
+// if it went backwards. millis() stalls in critical sections (SysTick is
+// masked), so it only counts the overflows of long gaps.
+inline uint64_t trace_cycles() {
+    uint32_t cycles = ARM_DWT_CYCCNT;
+    uint32_t ms = millis();
+    uint32_t elapsed = ms - trace_last_ms;
+    if (elapsed < TraceLongGapMs) {
+        if (cycles < trace_last_cycles)
+            trace_wraps++;
+    } else {
+        int64_t expected = (int64_t) elapsed * (F_CPU_ACTUAL / 1000);
+        uint32_t d = cycles - trace_last_cycles;
+        int64_t wraps = (expected - d + (1ll << 31)) >> 32;
+        if (wraps > 0)
+            trace_wraps += wraps;
+    }
+    trace_last_cycles = cycles;
+    trace_last_ms = ms;
+    return ((uint64_t) trace_wraps << 32) | cycles;
+}
+
+inline void trace_event(uint8_t signal, uint32_t value) {
+    if (!trace_enabled) return;
+    trace_entry &e = trace_entries[trace_count++ & (TraceSize - 1)];
+    e.cycles = trace_cycles();
+    e.value = value;
+    e.signal = signal;
+}
+
+
+#define trace_mod_desc \
+    "Records time stamped firmware events in a ring buffer:\r\n" \
+    "  attack, glitch, running, success, broken, restart -> the triggers\r\n" \
+    "  reset   -> the reset pin is pulled low\r\n" \
+    "  cs      -> the chip-select edges seen\r\n" \
+    "  target  -> the restart status\r\n" \
+    "  packet  -> the svi2 packet on the bus (as sent)\r\n" \
+    "  result  -> the glitch results\r\n" \
+    "  error   -> errors (the negated twi return code or the attack error)"
+#define trace_cmd_desc \
+    "Prints how many events were recorded."
+#define trace_vcd_cmd_desc \
+    "Prints the recorded events as value change dump (VCD)."
+#define trace_clear_cmd_desc \
+    "Clears the recorded events."
+
+#define trace_enabled_desc \
+    "Whether events are recorded."
+
+extern cli_module trace_module;
+
+
+#endif /* TRACE_H */
@@ -0,0 +1,441 @@
+// Copyright (C) 2021 Niklas Jacob
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "prompt.h"
+
+#include "trigger.h"
+#include "restart.h"
+#include "glitch.h"
+#include "sniff.h"
+
+char            trigger_program[TriggerProgramSize] = DefaultTriggerProgram;
+uint32_t        trigger_timeout     = DefaultTriggerTimeout;
+
+trigger_step    trigger_steps[TriggerMaxSteps];
+unsigned        trigger_steps_n     = 0;
+
+bool            trigger_armed       = false;
+unsigned        trigger_pc          = 0;
+
+hw_target_var   trigger_pc_var      = make_hw_target_var(trigger_pc,    0);
+hw_target_var   trigger_target_vars = make_hw_target_var(trigger_armed, &trigger_pc_var);
+
+const char * const trigger_op_names[] = {
+    "off", "on", "low", "high", "cs", "width", "svi", "addr", "delay",
+};
+
+
+//////////////
+// Compiler //
+//////////////
+
+bool trigger_compile_error(const char * error, const char * word) {
+    print_str(error);
+    print_str(" (at \"");
+    print_str(word);
+    println("\")!");
+    return false;
+}
+
+bool trigger_parse_u32(uint32_t &v, const char * s, unsigned n) {
+    unsigned u;
+    if (stou(u, s, n) == 0) return false;
+    v = u;
+    return n == 0 || *s == 0;
+}
+
+// parses "A" or "A<sep>B", has_b tells whether B was given
+bool trigger_parse_args(char * s, unsigned n, char sep, uint32_t &a, uint32_t &b, bool &has_b) {
+    char * first;
+    unsigned first_n = get_word(first, s, n, sep);
+    if (!trigger_parse_u32(a, first, first_n)) return false;
+    has_b = n != 0;
+    return !has_b || trigger_parse_u32(b, s, n);
+}
+
+bool trigger_compile(const char * source, unsigned source_n, trigger_step * steps, unsigned &steps_n) {
+
+    char buffer[TriggerProgramSize];
+    unsigned n = str_len(source, source_n);
+    if (n >= TriggerProgramSize) {
+        println("Error: The trigger program is too long!");
+        return false;
+    }
+    for (unsigned i = 0; i < n; i++)
+        buffer[i] = source[i];
+    buffer[n] = 0;
+
+    char * s = buffer;
+    strip_start(s, n);
+
+    uint32_t timeout = trigger_timeout;
+    bool polled = true;
+    steps_n = 0;
+
+    while (n) {
+
+        char * word;
+        unsigned word_n = get_word(word, s, n);
+        word_n = str_len(word, word_n);
+
+        char * name;
+        unsigned name_n = get_word(name, word, word_n, ':');
+        bool has_args = word_n != 0;
+
+        uint32_t a = 0, b = 0;
+        bool has_b = false;
+        if (has_args) {
+            char sep = str_cmp(name, name_n, "svi", sizeof("svi")) == 0 ? '/' : '-';
+            if (!trigger_parse_args(word, word_n, sep, a, b, has_b))
+                return trigger_compile_error("Error: Couldn't parse the arguments", name);
+        }
+
+        if (str_cmp(name, name_n, "timeout", sizeof("timeout")) == 0) {
+            if (!has_args || has_b)
+                return trigger_compile_error("Error: Expected one number", name);
+            timeout = a;
+            continue;
+        }
+
+        uint8_t op;
+        if (str_cmp(name, name_n, "vid", sizeof("vid")) == 0) {
+            if (!has_args || has_b || a > 0xff)
+                return trigger_compile_error("Error: Expected a vid", name);
+            // the vid code is in bits 14..7 of the packet on the bus
+            op = trigger_op_svi;
+            a <<= 7;
+            b = 0xff << 7;
+        } else {
+            for (op = 0; op < sizeof(trigger_op_names)/sizeof(*trigger_op_names); op++)
+                if (str_cmp(name, name_n, trigger_op_names[op], str_len(trigger_op_names[op]) + 1) == 0)
+                    break;
+            if (op == sizeof(trigger_op_names)/sizeof(*trigger_op_names))
+                return trigger_compile_error("Error: Unknown step", name);
+        }
+
+        switch (op) {
+            case trigger_op_off:
+            case trigger_op_on:
+                if (has_args)
+                    return trigger_compile_error("Error: Expected no arguments", name);
+                if (!polled)
+                    return trigger_compile_error("Error: Can't wait for the restart detection after busy waiting", name);
+                break;
+            case trigger_op_low:
+            case trigger_op_high:
+                if (has_args)
+                    return trigger_compile_error("Error: Expected no arguments", name);
+                break;
+            case trigger_op_cs:
+            case trigger_op_delay:
+                if (!has_args || has_b)
+                    return trigger_compile_error("Error: Expected one number", name);
+                break;
+            case trigger_op_width:
+            case trigger_op_addr:
+                if (!has_args || !has_b || b < a)
+                    return trigger_compile_error("Error: Expected a range A-B", name);
+                if (op == trigger_op_addr && b > 0xffffff)
+                    return trigger_compile_error("Error: Flash addresses have 24 bits", name);
+                break;
+            case trigger_op_svi:
+                if (!has_args)
+                    return trigger_compile_error("Error: Expected a packet", name);
+                if (!has_b)
+                    b = 0xffffff;
+                if (a > 0xffffff || b > 0xffffff)
+                    return trigger_compile_error("Error: Packets have 24 bits", name);
+                break;
+        }
+
+        if (steps_n == TriggerMaxSteps)
+            return trigger_compile_error("Error: Too many steps", name);
+
+        polled = polled && op <= trigger_op_high;
+
+        steps[steps_n++] = {
+            .op         = op,
+            .polled     = polled,
+            .a          = a,
+            .b          = b,
+            .timeout    = timeout,
+        };
+    }
+
+    return true;
+}
+
+void trigger_print_step(const trigger_step &step) {
+    print_str(trigger_op_names[step.op]);
+    switch (step.op) {
+        case trigger_op_cs:
+        case trigger_op_delay:
+            print_char(' ');
+            print_hex_int(step.a);
+            break;
+        case trigger_op_width:
+        case trigger_op_addr:
+            print_char(' ');
+            print_hex_int(step.a);
+            print_char('-');
+            print_hex_int(step.b);
+            break;
+        case trigger_op_svi:
+            print_char(' ');
+            print_hex_int(step.a);
+            print_char('/');
+            print_hex_int(step.b);
+            break;
+    }
+    if (step.polled) {
+        print_str(" (polled)");
+    } else if (step.op != trigger_op_delay) {
+        print_str(" (timeout ");
+        print_hex_int(step.timeout);
+        print_char(')');
+    }
+}
+
+
+/////////
+// CLI //
+/////////
+
+bool trigger_program_set(void * pThis, const char * value, unsigned n) {
+    trigger_step steps[TriggerMaxSteps];
+    unsigned steps_n;
+    if (!trigger_compile(value, n, steps, steps_n))
+        return false;
+    n = str_len(value, n);
+    for (unsigned i = 0; i < n; i++)
+        trigger_program[i] = value[i];
+    trigger_program[n] = 0;
+    trigger_armed = false;
+    return true;
+}
+
+bool trigger_program_reset(void * pThis) {
+    return trigger_program_set(pThis, DefaultTriggerProgram, sizeof(DefaultTriggerProgram));
+}
+
+bool trigger_program_print(void * pThis) {
+    print_str(trigger_program);
+    return true;
+}
+
+cli_param_u32 trigger_timeout_this = make_cli_param_u32(trigger_timeout, DefaultTriggerTimeout, 0, 0xffffffff);
+
+cli_param trigger_timeout_param = make_cli_param_u32_param("timeout", trigger_timeout_desc, trigger_timeout_this, 0);
+
+cli_param trigger_program_param = {
+    .name           = "program",
+    .description    = trigger_program_desc,
+    .pThis          = 0,
+    .set            = trigger_program_set,
+    .reset          = trigger_program_reset,
+    .print          = trigger_program_print,
+    .next           = &trigger_timeout_param,
+};
+
+bool trigger_arm(void * pThis) {
+    if (!trigger_compile(trigger_program, TriggerProgramSize, trigger_steps, trigger_steps_n))
+        return false;
+    trigger_pc = 0;
+    trigger_armed = true;
+    println("Trigger armed!");
+    return true;
+}
+
+bool trigger_show(void * pThis) {
+    trigger_step steps[TriggerMaxSteps];
+    unsigned steps_n;
+    if (!trigger_compile(trigger_program, TriggerProgramSize, steps, steps_n))
+        return false;
+    for (unsigned i = 0; i < steps_n; i++) {
+        print_hex_byte(i);
+        print_str(": ");
+        trigger_print_step(steps[i]);
+        println();
+    }
+    println("then glitch");
+    return true;
+}
+
+cli_command trigger_show_cmd = {
+    .name           = "show",
+    .description    = trigger_show_cmd_desc,
+    .pThis          = 0,
+    .exec           = &trigger_show,
+    .next           = 0,
+};
+
+cli_command trigger_arm_cmd = {
+    .name           = "",
+    .description    = trigger_cmd_desc,
+    .pThis          = 0,
+    .exec           = &trigger_arm,
+    .next           = &trigger_show_cmd,
+};
+
+cli_module trigger_module = {
+    .name           = "trigger",
+    .description    = trigger_mod_desc,
+    .param          = &trigger_program_param,
+    .cmd            = &trigger_arm_cmd,
+    .next           = 0,
+};
+
+
+//////////////
+// Executor //
+//////////////
+
+bool trigger_poll_step(const trigger_step &step) {
+    switch (step.op) {
+        case trigger_op_off:
+            return restart_is_off();
+        case trigger_op_on:
+            return restart_is_running();
+        case trigger_op_low:
+            return hw.cs_pin.is_low() && hw.cs_pin.is_low();
+        case trigger_op_high:
+            return hw.cs_pin.is_high() && hw.cs_pin.is_high();
+        default:
+            return false;
+    }
+}
+
+// Busy waits for a step, returns an error message or zero on success.
+const char * trigger_run_step(const trigger_step &step) {
+
+    uint32_t timeout, budget;
+
+    switch (step.op) {
+
+        case trigger_op_low:
+            timeout = step.timeout;
+            BUSY_LOOP_WHILE_PIN_HIGH(trigger_low, timeout, hw.cs_pin);
+            if (timeout == 0) return "Error: CS was high for too long!";
+            return 0;
+
+        case trigger_op_high:
+            timeout = step.timeout;
+            BUSY_LOOP_WHILE_PIN_LOW(trigger_high, timeout, hw.cs_pin);
+            if (timeout == 0) return "Error: CS was low for too long!";
+            return 0;
+
+        case trigger_op_cs:
+            for (uint32_t i = 0; i < step.a; i++) {
+                timeout = step.timeout;
+                BUSY_LOOP_WHILE_PIN_LOW(trigger_cs_low, timeout, hw.cs_pin);
+                if (timeout == 0) return "Error: CS was low for too long!";
+                timeout = step.timeout;
+                BUSY_LOOP_WHILE_PIN_HIGH(trigger_cs_high, timeout, hw.cs_pin);
+                if (timeout == 0) return "Error: CS was high for too long!";
+            }
+            return 0;
+
+        case trigger_op_width:
+            // the pulse has to be seen from its start
+            budget = step.timeout;
+            BUSY_LOOP_WHILE_PIN_LOW(trigger_width_skip, budget, hw.cs_pin);
+            while (budget) {
+                BUSY_LOOP_WHILE_PIN_HIGH(trigger_width_high, budget, hw.cs_pin);
+                if (budget == 0) break;
+                timeout = budget;
+                BUSY_LOOP_WHILE_PIN_LOW(trigger_width_low, budget, hw.cs_pin);
+                timeout -= budget;
+                if (budget && step.a <= timeout && timeout <= step.b)
+                    return 0;
+            }
+            return "Error: No chip-select pulse of the given width!";
+
+        case trigger_op_svi: {
+            uint32_t wire;
+            uint8_t nacks;
+            budget = step.timeout;
+            while (sniff_svi2_packet(wire, nacks, budget) != -1)
+                if ((wire & step.b) == step.a)
+                    return 0;
+            return "Error: No matching svi2 packet was sent!";
+        }
+
+        case trigger_op_addr: {
+            if (!hw_spi_enabled) return "Error: The spi sniffer is off (hw config both)!";
+            // drop frames of earlier flash accesses
+            spi_sniffer.clear();
+            int rc = spi_sniffer.wait_for_read(step.a, step.b, step.timeout);
+            if (rc == -1) return "Error: The flash address range wasn't read!";
+            if (rc < 0) return "Error: The spi sniffer lost frames!";
+            return 0;
+        }
+
+        case trigger_op_delay:
+            timeout = step.a;
+            BUSY_LOOP(trigger_delay, timeout);
+            return 0;
+
+        default:
+            return "Error: Unknown step (this should never happen)!";
+    }
+}
+
+void trigger_process() {
+
+    if (!trigger_armed) return;
+    // Trigger armed
+
+    // polled steps may take many main loop iterations
+    while (trigger_pc < trigger_steps_n && trigger_steps[trigger_pc].polled) {
+        if (!trigger_poll_step(trigger_steps[trigger_pc]))
+            return;
+        trigger_pc++;
+    }
+
+    // the remaining steps are busy waited for
+    hw_critical_begin();
+    hw_trigger_attack_set_high();
+    trigger_armed = false;
+
+    const char * error = 0;
+    for (; trigger_pc < trigger_steps_n; trigger_pc++) {
+        error = trigger_run_step(trigger_steps[trigger_pc]);
+        if (error) break;
+    }
+    hw_trigger_attack_set_low();
+
+    if (error) {
+        hw_critical_end();
+        prompt_use_new_line();
+        print_str("Trigger failed at step ");
+        print_hex_byte(trigger_pc);
+        print_str(": ");
+        trigger_print_step(trigger_steps[trigger_pc]);
+        println();
+        println(error);
+        return;
+    }
+
+    // Glitch now
+    glitch_result result = glitch();
+
+    prompt_use_new_line();
+    println("Trigger fired!");
+    if (glitch_cs_was_low_at_glitch)
+        println("Chip-Select was low at glitch time!");
+    glitch_print_result(result);
+    hw_critical_end();
+}
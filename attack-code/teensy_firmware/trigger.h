@@ -0,0 +1,97 @@
+// Copyright (C) 2021 Niklas Jacob
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef TRIGGER_H
+#define TRIGGER_H
+
+#include "hw.h"
+#include "cli.h"
+
+
+constexpr unsigned  TriggerProgramSize      = 128;
+constexpr unsigned  TriggerMaxSteps         = 16;
+
+// same as the default attack (cs trigger with 20 waits)
+#define DefaultTriggerProgram "off low cs:20"
+
+// longest chip-select pulse found was 33 us
+constexpr uint32_t  DefaultTriggerTimeout   = rough_busy_wait_us(100);
+
+enum trigger_op : uint8_t {
+    trigger_op_off,
+    trigger_op_on,
+    trigger_op_low,
+    trigger_op_high,
+    trigger_op_cs,
+    trigger_op_width,
+    trigger_op_svi,
+    trigger_op_addr,
+    trigger_op_delay,
+};
+
+// A compiled step of a trigger program, all arguments and timeouts are
+// resolved when compiling, so the busy waited steps don't need to parse
+// or look anything up.
+struct trigger_step {
+    uint8_t     op;
+    // checked once per main loop iteration instead of busy waiting
+    bool        polled;
+    uint32_t    a, b;
+    uint32_t    timeout;
+};
+
+void trigger_process();
+
+
+#define trigger_mod_desc \
+    "Triggers the glitch module after a sequence of events described by\r\n" \
+    "a trigger program. The program is a space separated list of steps:\r\n" \
+    "  off          -> the restart detection considers the target off\r\n" \
+    "  on           -> the restart detection considers the target on\r\n" \
+    "  low, high    -> chip-select is low (high)\r\n" \
+    "  cs:N         -> N chip-select low-pulses have ended and the next\r\n" \
+    "                  one started\r\n" \
+    "  width:A-B    -> a chip-select low-pulse that was A to B busy loop\r\n" \
+    "                  cycles long has ended\r\n" \
+    "  svi:V[/M]    -> a svi2 packet whose 24 bits on the bus (address\r\n" \
+    "                  byte first, without acks) masked by M equal V\r\n" \
+    "  vid:V        -> a svi2 packet setting the vid V\r\n" \
+    "  addr:A-B     -> the flash is read at an address from A to B\r\n" \
+    "                  (see \"help attack trigger\")\r\n" \
+    "  delay:T      -> T busy loop cycles have passed\r\n" \
+    "  timeout:T    -> the following steps fail after T busy loop cycles\r\n" \
+    "                  (instead of the timeout parameter)\r\n" \
+    "The off, on and leading low or high steps are checked once per main\r\n" \
+    "loop iteration, all other steps are busy waited for without any\r\n" \
+    "interruption. Example: \"off low cs:20\" is the default attack."
+#define trigger_cmd_desc \
+    "Compiles and arms the trigger program."
+#define trigger_show_cmd_desc \
+    "Prints the compiled steps of the trigger program."
+
+#define trigger_program_desc \
+    "The trigger program (see \"help trigger\")."
+#define trigger_timeout_desc \
+    "How many busy loop cycles a step may take at most, unless the\r\n" \
+    "program sets another timeout."
+
+// the per-target state (see hw_target_vars_append)
+extern hw_target_var trigger_target_vars;
+
+extern cli_module trigger_module;
+
+
+#endif /* TRIGGER_H */
@@ -0,0 +1,159 @@
+# Copyright (C) 2021 Niklas Jacob
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+# A simple electrical model of the voltage regulator's response to a glitch.
+#
+# The rail slews (with a limited rate) from the default voltage towards the
+# glitch voltage, once the glitch command was processed, and back when the
+# default vid is restored. The load line and the offset trim shift both
+# voltages, the power level (psi) scales the slew rates.
+#
+# All functions take numpy arrays (or scalars) and broadcast, so millions
+# of glitch plans can be scored at once. Times are in us, voltages in mV.
+
+import numpy as np
+
+# busy loop cycles of the firmware per us
+BUSY_LOOP_PER_US = 60.0
+
+# SVI2: vid 0 is 1.55 V, every step is 6.25 mV lower, 0xf8 and up is off
+def vid_to_mv(vid):
+    vid = np.asarray(vid)
+    return np.where(vid >= 0xf8, 0.0, 1550.0 - 6.25 * vid)
+
+# amd_svi2.hpp: OffsetTrim (off, -25mV, no_change, +25mV)
+OFFSET_MV = np.array([0.0, -25.0, 0.0, 25.0])
+
+# amd_svi2.hpp: LoadLineSlopeTrim (off, -40%, -20%, no_change, +20%, ...)
+LOADLINE_FACTOR = np.array([0.0, 0.6, 0.8, 1.0, 1.2, 1.4, 1.6, 1.8])
+
+# parameters and their initial values (or fitted values)
+PARAMS = {
+    # slew rates of the rail when moving down (up)
+    'slew_down_mv_per_us' : 50.0,
+    'slew_up_mv_per_us' : 50.0,
+    # from the start of the glitch command until the rail starts moving,
+    # the same latency applies to the restoring command
+    'latency_us' : 6.0,
+    # voltage drop of the load line (load current times resistance)
+    'droop_mv' : 20.0,
+    # slew rate factors of the power levels (PowerLevel: low, mid, ...)
+    'psi_low' : 0.25,
+    'psi_mid' : 0.5,
+}
+
+class Plan:
+    """A glitch plan, every member may be an array of candidates."""
+
+    def __init__(self, vid, duration, default_vid, offset=2, loadline=3, power=3):
+        self.vid = np.asarray(vid)
+        # busy loop cycles (glitch duration)
+        self.duration = np.asarray(duration)
+        self.default_vid = np.asarray(default_vid)
+        self.offset = np.asarray(offset)
+        self.loadline = np.asarray(loadline)
+        self.power = np.asarray(power)
+
+class VrModel:
+
+    def __init__(self, **params):
+        self.params = dict(PARAMS)
+        self.params.update(params)
+
+    def __rails(self, plan):
+        p = self.params
+        shift = OFFSET_MV[plan.offset] - p['droop_mv'] * LOADLINE_FACTOR[plan.loadline]
+        psi = np.choose(plan.power, [p['psi_low'], p['psi_mid'], 1.0, 1.0])
+        v0 = vid_to_mv(plan.default_vid) + shift
+        vt = vid_to_mv(plan.vid) + shift
+        d = plan.duration / BUSY_LOOP_PER_US
+        sd = p['slew_down_mv_per_us'] * psi
+        su = p['slew_up_mv_per_us'] * psi
+        # lowest voltage, when the restoring command takes effect
+        vmin = np.maximum(vt, v0 - sd * d)
+        return v0, vt, vmin, d, sd, su
+
+    def waveform(self, plan, t):
+        """The rail at the times t (relative to the start of the glitch)."""
+        v0, vt, vmin, d, sd, su = self.__rails(plan)
+        t = np.asarray(t) - self.params['latency_us']
+        down = np.maximum(vt, v0 - sd * np.clip(t, 0, None))
+        up = np.minimum(v0, vmin + su * (t - d))
+        return np.where(t < d, down, up)
+
+    def min_mv(self, plan):
+        return self.__rails(plan)[2]
+
+    def below_us(self, plan, threshold_mv):
+        """How long the rail is below the threshold."""
+        v0, vt, vmin, d, sd, su = self.__rails(plan)
+        start = (v0 - threshold_mv) / sd
+        end = d + (threshold_mv - vmin) / su
+        return np.where(vmin < threshold_mv, np.maximum(end - start, 0), 0.0)
+
+    def score(self, plan, depth_mv, threshold_mv=None, below_us=None):
+        """Distance (in mV, smaller is better) of the predicted minimum to
+        depth_mv, optionally plus the deviation (in us, weighted 1:1) of
+        the time below the threshold."""
+        s = np.abs(self.min_mv(plan) - depth_mv)
+        if threshold_mv is not None and below_us is not None:
+            s = s + np.abs(self.below_us(plan, threshold_mv) - below_us)
+        return s
+
+    def prefilter(self, plan, depth_mv, tolerance_mv):
+        """The candidates whose predicted minimum is close to depth_mv."""
+        return np.abs(self.min_mv(plan) - depth_mv) <= tolerance_mv
+
+    def fit(self, captures, rounds=20, samples=4096, seed=0):
+        """Fits the parameters to recorded rail captures.
+
+        captures is a list of (plan, t, mv) tuples with the sample times t
+        (us relative to the start of the glitch) and the measured rail
+        voltages mv (e.g. the waveform points reported by the rail module).
+
+        All candidates of a round are evaluated at once, every round
+        narrows the search around the best candidate so far."""
+        r = np.random.default_rng(seed)
+        names = list(PARAMS.keys())
+        best = np.array([self.params[n] for n in names], dtype=float)
+        spread = np.abs(best) + 1.0
+
+        def error(cand):
+            model = VrModel(**{n : cand[:, i, None] for (i, n) in enumerate(names)})
+            e = np.zeros(len(cand))
+            for (plan, t, mv) in captures:
+                t = np.asarray(t, dtype=float)[None, :]
+                e += np.mean((model.waveform(plan, t) - np.asarray(mv)[None, :])**2, axis=1)
+            return e
+
+        best_error = error(best[None, :])[0]
+        for _ in range(rounds):
+            cand = best + spread * r.uniform(-1, 1, (samples, len(names)))
+            cand = np.clip(cand, 1e-3, None)
+            e = error(cand)
+            i = np.argmin(e)
+            if e[i] < best_error:
+                best, best_error = cand[i], e[i]
+            spread *= .7
+
+        self.params = {n : float(v) for (n, v) in zip(names, best)}
+        return np.sqrt(best_error / max(len(captures), 1))
+
+def capture_from_rail(plan, rail, pre_samples, sample_ns):
+    """Converts a rail measurement of TeensyClient.last_rail into a capture
+    for VrModel.fit (the waveform starts pre_samples before the glitch)."""
+    n = len(rail['waveform_mv'])
+    t = (np.arange(n) + .5) * rail['point_ns'] / 1000.0 - pre_samples * sample_ns / 1000.0
+    return (plan, t, np.array(rail['waveform_mv'], dtype=float))